@@ -31,7 +31,9 @@
   "random-bal.rep",\
   "random2-bal.rep",\
   "binary-bal.rep",\
-  "binary2-bal.rep"
+  "binary2-bal.rep",\
+  "realloc-bal.rep",\
+  "realloc2-bal.rep"
 
 
 
@@ -57,16 +59,135 @@
  */
 #define ALIGNMENT 16
 
+/*
+ * Set USE_MMAP_HEAP to 1 to have memlib reserve MAX_HEAP bytes of address
+ * space with mmap and commit pages only as the heap grows, so that the
+ * limit can be large without costing memory. Set it to 0 to malloc the
+ * whole heap up front.
+ */
+#ifndef USE_MMAP_HEAP
+#define USE_MMAP_HEAP 1
+#endif
+
 /* 
  * Maximum heap size in bytes 
  */
+#if USE_MMAP_HEAP
+#define MAX_HEAP (1<<30)  /* 1 GB */
+#else
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_CLOCK  1   /* clock_gettime(CLOCK_MONOTONIC_RAW) w/K-best scheme (Linux) */
+
+/*
+ * Set MM_THREADS to 1 (e.g. with -DMM_THREADS=1, as "make mdriver.mt"
+ * does) to build mm.c with a locked shared heap and per-thread caches, so
+ * that mm_malloc/mm_free can be called from several threads at once.
+ */
+#ifndef MM_THREADS
+#define MM_THREADS 0
+#endif
+
+/*
+ * Set MM_CHECK to 1 (as "make mdriver.check" does) to have mm.c check the
+ * blocks each call touches, and then advance a walk over the whole heap
+ * and the free lists for about MM_CHECK_BUDGET nanoseconds, aborting on
+ * the first inconsistency it finds.
+ */
+#ifndef MM_CHECK
+#define MM_CHECK 0
+#endif
+#ifndef MM_CHECK_BUDGET
+#define MM_CHECK_BUDGET 1000
+#endif
+
+/*
+ * Policies of mm.c, fixed at compile time so that trying one costs nothing
+ * at run time. "make policies" builds a driver for each configuration
+ * listed in the Makefile, and "make sweep" compares them.
+ *
+ * MM_FIT chooses the block a request takes from the large-block tree
+ * (with MM_INDEX_TREE):
+ *   MM_FIT_BEST   the smallest block that fits (lowest address among equals)
+ *   MM_FIT_FIRST  the first block that fits on the way down from the root,
+ *                 which examines fewer blocks but fits less tightly
+ * MM_LARGE_INDEX chooses how the large free blocks are kept:
+ *   MM_INDEX_TREE   an AVL tree whose nodes are the free blocks themselves;
+ *                   every insert and remove rebalances the path to the
+ *                   root, reading blocks all over the heap, which costs
+ *                   about 20% of throughput with few large blocks (e.g.
+ *                   binary) and 30% with many (random)
+ *   MM_INDEX_ARRAY  a sorted array of their sizes and addresses outside the
+ *                   heap, so that a search reads contiguous memory and
+ *                   touches only the block it returns, but inserting and
+ *                   removing a block moves the entries after it; beyond a
+ *                   few hundred blocks, they go in the tree for a while
+ *                   (MM_FIT then makes no difference until they do)
+ * MM_LIST_ORDER chooses where a freed small block goes on its list, and so
+ * which block of that size is reused first:
+ *   MM_ORDER_LIFO     at the head: the most recently freed
+ *   MM_ORDER_FIFO     at the tail: the least recently freed
+ *   MM_ORDER_ADDRESS  in address order: the lowest in memory
+ * MM_GROWTH chooses how much the heap grows when no free block fits:
+ *   MM_GROW_PROPORTIONAL  a fraction of the heap size (see grow_size)
+ *   MM_GROW_CHUNK         the request, but at least MM_CHUNKSIZE bytes
+ * MM_CHUNKSIZE is the initial heap size and the smallest growth step, and
+ * MM_SPLIT_MIN the smallest remainder split off a block as a free block
+ * (both in bytes, multiples of 16; MM_SPLIT_MIN at least 32).
+ * MM_REALLOC_ROOM chooses the headroom mm_realloc leaves in a block it has
+ * already resized MM_REALLOC_HOT times (1 to 3), so that it can grow in
+ * place next time, at the cost of the unused room:
+ *   MM_ROOM_NONE       none: the block fits the request
+ *   MM_ROOM_SLACK      MM_REALLOC_SLACK percent of the request
+ *   MM_ROOM_GEOMETRIC  up to the next geometric size class, four per
+ *                      power of two
+ */
+#define MM_FIT_BEST           0
+#define MM_FIT_FIRST          1
+#define MM_ORDER_LIFO         0
+#define MM_ORDER_FIFO         1
+#define MM_ORDER_ADDRESS      2
+#define MM_INDEX_TREE         0
+#define MM_INDEX_ARRAY        1
+#define MM_GROW_PROPORTIONAL  0
+#define MM_GROW_CHUNK         1
+#define MM_ROOM_NONE          0
+#define MM_ROOM_SLACK         1
+#define MM_ROOM_GEOMETRIC     2
+
+#ifndef MM_FIT
+#define MM_FIT MM_FIT_BEST
+#endif
+#ifndef MM_LARGE_INDEX
+#define MM_LARGE_INDEX MM_INDEX_ARRAY
+#endif
+#ifndef MM_LIST_ORDER
+#define MM_LIST_ORDER MM_ORDER_LIFO
+#endif
+#ifndef MM_GROWTH
+#define MM_GROWTH MM_GROW_PROPORTIONAL
+#endif
+#ifndef MM_CHUNKSIZE
+#define MM_CHUNKSIZE (1<<12)
+#endif
+#ifndef MM_SPLIT_MIN
+#define MM_SPLIT_MIN 32
+#endif
+#ifndef MM_REALLOC_ROOM
+#define MM_REALLOC_ROOM MM_ROOM_GEOMETRIC
+#endif
+#ifndef MM_REALLOC_SLACK
+#define MM_REALLOC_SLACK 50
+#endif
+#ifndef MM_REALLOC_HOT
+#define MM_REALLOC_HOT 1
+#endif
 
 #endif /* __CONFIG_H */
@@ -5,11 +5,15 @@
  * May not be used, modified, or copied without permission.
  *
  * Uses the cycle timer routines in clock.c to estimate the
- * the time in CPU cycles for a function f.
+ * the time in CPU cycles for a function f. fcyc_secs applies the same
+ * K-best scheme to clock_gettime(CLOCK_MONOTONIC_RAW), which any Linux
+ * box has, to estimate the time in seconds.
  */
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <math.h>
+#include <time.h>
 
 #include "fcyc.h"
 #include "clock.h"
@@ -22,6 +26,8 @@
 #define CLEAR_CACHE 0        /* Clear cache before running test function */
 #define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
 #define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define WARMUP 0             /* Untimed runs before the first sample */
+#define MIN_SECS 0           /* Shortest sample fcyc_secs takes (secs) */
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
@@ -30,11 +36,14 @@ static int compensate = COMPENSATE;
 static int clear_cache = CLEAR_CACHE;
 static int cache_bytes = CACHE_BYTES;
 static int cache_block = CACHE_BLOCK;
+static int warmup = WARMUP;
+static double min_secs = MIN_SECS;
 
 static int *cache_buf = NULL;
 
 static double *values = NULL;
 static int samplecount = 0;
+static double samplesum = 0, samplesumsq = 0; /* of all samples, for fcyc_ci */
 
 /* for debugging only */
 #define KEEP_VALS 0
@@ -59,6 +68,7 @@ static void init_sampler()
     samples = calloc(maxsamples+kbest, sizeof(double));
 #endif
     samplecount = 0;
+    samplesum = samplesumsq = 0;
 }
 
 /* 
@@ -78,6 +88,8 @@ static void add_sample(double val)
     samples[samplecount] = val;
 #endif
     samplecount++;
+    samplesum += val;
+    samplesumsq += val * val;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
 	double temp = values[pos-1];
@@ -129,6 +141,10 @@ static void clear()
 double fcyc(test_funct f, void *argp)
 {
     double result;
+    int i;
+
+    for (i = 0; i < warmup; i++)
+	f(argp);
     init_sampler();
     if (compensate) {
 	do {
@@ -168,6 +184,78 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * clock_secs - Read the raw monotonic clock, which NTP does not slew
+ */
+static double clock_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * fcyc_secs - Use K-best scheme to estimate the running time of function
+ *     f in seconds, timed with the raw monotonic clock. The last warm-up
+ *     run is timed too, and a sample repeats f as often as it takes to
+ *     last min_secs, so that short functions are not lost in the clock's
+ *     own overhead.
+ */
+double fcyc_secs(test_funct f, void *argp)
+{
+    double result, start, secs = 0;
+    int i, reps = 1;
+
+    for (i = 0; i < warmup; i++) {
+	start = clock_secs();
+	f(argp);
+	secs = clock_secs() - start;
+    }
+    if (secs > 0 && secs < min_secs)
+	reps = (int)ceil(min_secs / secs);
+
+    init_sampler();
+    do {
+	if (clear_cache)
+	    clear();
+	start = clock_secs();
+	for (i = 0; i < reps; i++)
+	    f(argp);
+	add_sample((clock_secs() - start) / reps);
+    } while (!has_converged() && samplecount < maxsamples);
+
+    result = values[0];
+#if !KEEP_VALS
+    free(values); 
+    values = NULL;
+#endif
+    return result;  
+}
+
+/*
+ * fcyc_ci - Half-width of a 95% confidence interval for the mean of the
+ *     samples taken by the last fcyc or fcyc_secs call (Student's t), in
+ *     the same units; 0 if there was only one sample
+ */
+double fcyc_ci(void)
+{
+    /* t(0.975, df) for df = 1..30; beyond that, the normal 1.96 */
+    static const double t[30] = {
+	12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23,
+	2.20, 2.18, 2.16, 2.14, 2.13, 2.12, 2.11, 2.10, 2.09, 2.09,
+	2.08, 2.07, 2.07, 2.06, 2.06, 2.06, 2.05, 2.05, 2.05, 2.04};
+    int n = samplecount;
+    double mean, var;
+
+    if (n < 2)
+	return 0;
+    mean = samplesum / n;
+    var = (samplesumsq - n * mean * mean) / (n - 1);
+    return (n - 1 <= 30 ? t[n - 2] : 1.96) * sqrt(var > 0 ? var : 0) / sqrt(n);
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
@@ -245,6 +333,27 @@ void set_fcyc_epsilon(double epsilon_arg)
     epsilon = epsilon_arg;
 }
 
+/* 
+ * set_fcyc_warmup - Number of untimed runs of the test function
+ *     before the first sample.
+ *     Default = 0
+ */
+void set_fcyc_warmup(int n)
+{
+    warmup = n;
+}
+
+/* 
+ * set_fcyc_min_secs - Shortest time a sample of fcyc_secs may take;
+ *     a sample repeats a faster function (timed during the warm-up
+ *     runs) until it takes that long.
+ *     Default = 0
+ */
+void set_fcyc_min_secs(double secs)
+{
+    min_secs = secs;
+}
+
 
 
 
@@ -13,6 +13,14 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Compute number of seconds used by test function f, timed with
+   clock_gettime(CLOCK_MONOTONIC_RAW) */
+double fcyc_secs(test_funct f, void* argp);
+
+/* Half-width of a 95% confidence interval for the mean of the samples
+   taken by the last fcyc or fcyc_secs call, in the same units */
+double fcyc_ci(void);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -63,6 +71,19 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
+/* 
+ * set_fcyc_warmup - Number of untimed runs before the first sample
+ *     Default = 0
+ */
+void set_fcyc_warmup(int n);
+
+/* 
+ * set_fcyc_min_secs - Shortest time a sample of fcyc_secs may take
+ *     (a faster function is repeated within each sample)
+ *     Default = 0
+ */
+void set_fcyc_min_secs(double secs);
+
 
 
 
@@ -36,6 +36,18 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_CLOCK
+    if (verbose)
+	printf("Measuring performance with clock_gettime(CLOCK_MONOTONIC_RAW), "
+	       "best of 3 within 1%%.\n");
+
+    /* one warm-up run, then samples of at least a millisecond until the
+       3 fastest are within 1% of each other, or 20 samples were taken */
+    set_fcyc_maxsamples(20);
+    set_fcyc_epsilon(0.01);
+    set_fcyc_k(3);
+    set_fcyc_warmup(1);
+    set_fcyc_min_secs(1e-3);
 #endif
 }
 
@@ -51,7 +63,25 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_CLOCK
+    return fcyc_secs(f, argp);
 #endif 
 }
 
+/*
+ * fsecs_ci - Return the half-width (in seconds) of a 95% confidence
+ *     interval for the mean running time of the last fsecs call, or 0
+ *     when the timing method takes no separate samples
+ */
+double fsecs_ci(void)
+{
+#if USE_FCYC
+    return fcyc_ci()/(Mhz*1e6);
+#elif USE_CLOCK
+    return fcyc_ci();
+#else
+    return 0;
+#endif
+}
+
 
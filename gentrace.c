@@ -0,0 +1,455 @@
+/*
+ * gentrace.c - write synthetic traces of any length for mdriver
+ *
+ * usage: gentrace [-b] [-n <ops>] [-s <dist>] [-l <dist>] [-r <pct>]
+ *                 [-g <growth>] [-c <pct>] [-p <bytes>] [-S <seed>] <out>
+ *
+ * Each request is, in this order of preference:
+ *   - a free of the live block that is due to die first, if its lifetime
+ *     is over, or if only enough requests are left to free all live blocks
+ *     (so that the trace ends with an empty heap, like the -bal traces);
+ *   - with probability -r percent, a realloc of a random live block, grown
+ *     as -g says, unless that would go over the peak;
+ *   - an allocation of a size drawn from -s, made with calloc with
+ *     probability -c percent. If it would take the live bytes over the
+ *     peak (-p), the block due to die first is freed instead, and the
+ *     allocation is made by a later request.
+ * Every block draws its lifetime, in requests, from -l when it is
+ * allocated. The ids of freed blocks are reused, so that the trace has
+ * about as many ids as the heap has live blocks at its fullest.
+ *
+ * Distributions are given as
+ *   fixed:<n>                     always n
+ *   uniform:<lo>:<hi>             uniformly between lo and hi
+ *   power:<lo>:<hi>:<alpha>       power law between lo and hi, the
+ *                                 probability of x going as x^-alpha
+ *   bimodal:<a>:<b>:<pct>         a with probability pct percent, else b
+ *   exp:<mean>                    exponential with the given mean
+ * and growth as mul:<factor> (the new size is factor times the old one)
+ * or add:<bytes>. Byte counts may end in k, m or g.
+ *
+ * The trace is generated twice with the same seed, once to fill in the
+ * header and once to write it, so that it never has to be held in memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include "tracefmt.h"
+
+#define OP_BUF  4096  /* ops written at a time */
+
+/* A distribution to draw sizes or lifetimes from */
+typedef enum {D_FIXED, D_UNIFORM, D_POWER, D_BIMODAL, D_EXP} dist_kind_t;
+
+typedef struct {
+    dist_kind_t kind;
+    double a, b, c;   /* the parameters, in the order they are given */
+} dist_t;
+
+/* A live block, in the heap of blocks ordered by the time they die */
+typedef struct {
+    long long death;  /* request at which the block is freed */
+    int id;
+    int size;
+} live_t;
+
+/* What to generate */
+static long long num_ops = 1000000;
+static dist_t size_dist = {D_POWER, 16, 4096, 1.2};
+static dist_t life_dist = {D_EXP, 1000, 0, 0};
+static double realloc_pct, calloc_pct;
+static int grow_add;          /* growth: add grow_by bytes, or multiply by it */
+static double grow_by = 1.5;
+static long long peak_limit = 64LL << 20;
+
+/* The state of one pass */
+static unsigned long long rng;
+static live_t *heap;          /* binary min-heap on death */
+static int num_live, max_live;
+static int *free_ids;         /* ids that can be used again */
+static int num_free_ids, num_ids;
+static long long live, peak;  /* live payload bytes, and the most there were */
+
+/* The ops not yet written */
+static traceop_t buf[OP_BUF];
+static int buf_used;
+
+/*
+ * random64 - Returns the next number of the splitmix64 sequence
+ */
+static unsigned long long random64(void)
+{
+    unsigned long long z = (rng += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * uniform01 - Returns a number uniformly distributed in [0, 1)
+ */
+static double uniform01(void)
+{
+    return (random64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * draw - Returns a number drawn from dist, at least 1
+ */
+static long long draw(const dist_t *dist)
+{
+    double u = uniform01(), x, e;
+
+    switch (dist->kind) {
+    case D_FIXED:
+        x = dist->a;
+        break;
+    case D_UNIFORM:
+        x = dist->a + u * (dist->b - dist->a + 1);
+        break;
+    case D_POWER:
+        /* inverse of the CDF of x^-alpha on [a, b] */
+        if (fabs(dist->c - 1) < 1e-9) {
+            x = dist->a * pow(dist->b / dist->a, u);
+        } else {
+            e = 1 - dist->c;
+            x = pow(pow(dist->a, e) + u * (pow(dist->b, e) - pow(dist->a, e)), 1 / e);
+        }
+        break;
+    case D_BIMODAL:
+        x = u * 100 < dist->c ? dist->a : dist->b;
+        break;
+    default:
+        x = -dist->a * log(1 - u);
+        break;
+    }
+    return x < 1 ? 1 : x > (double)LLONG_MAX / 2 ? LLONG_MAX / 2 : (long long)x;
+}
+
+/*
+ * heap_up, heap_down - Restore the heap order above or below slot i
+ */
+static void heap_up(int i)
+{
+    live_t b = heap[i];
+
+    while (i > 0 && heap[(i - 1) / 2].death > b.death) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = b;
+}
+
+static void heap_down(int i)
+{
+    live_t b = heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < num_live) {
+        if (child + 1 < num_live && heap[child + 1].death < heap[child].death)
+            child++;
+        if (heap[child].death >= b.death)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = b;
+}
+
+/*
+ * emit - Write an op (if fp is not NULL), keeping track of the live bytes
+ */
+static void emit(FILE *fp, int binary, int type, int id, int size)
+{
+    if (live > peak)
+        peak = live;
+    if (fp == NULL)
+        return;
+    buf[buf_used].type = type;
+    buf[buf_used].index = id;
+    buf[buf_used].size = size;
+    buf[buf_used].align = 0;
+    if (++buf_used == OP_BUF) {
+        if ((binary ? trace_write_bin_ops(fp, buf, buf_used) :
+             trace_write_rep_ops(fp, buf, buf_used)) < 0) {
+            perror("gentrace");
+            exit(1);
+        }
+        buf_used = 0;
+    }
+}
+
+/*
+ * free_first - Free the live block that is due to die first
+ */
+static void free_first(FILE *fp, int binary)
+{
+    live_t b = heap[0];
+
+    live -= b.size;
+    heap[0] = heap[--num_live];
+    if (num_live > 0)
+        heap_down(0);
+    free_ids[num_free_ids++] = b.id;
+    emit(fp, binary, FREE, b.id, 0);
+}
+
+/*
+ * allocate - Allocate a block of size bytes at time now
+ */
+static void allocate(FILE *fp, int binary, int size, long long now)
+{
+    int id;
+
+    if (num_live == max_live) {
+        max_live = max_live ? 2 * max_live : 4096;
+        if ((heap = realloc(heap, max_live * sizeof(live_t))) == NULL ||
+            (free_ids = realloc(free_ids, max_live * sizeof(int))) == NULL) {
+            fprintf(stderr, "gentrace: out of memory\n");
+            exit(1);
+        }
+    }
+    id = num_free_ids > 0 ? free_ids[--num_free_ids] : num_ids++;
+    heap[num_live].death = now + draw(&life_dist);
+    heap[num_live].id = id;
+    heap[num_live].size = size;
+    heap_up(num_live++);
+    live += size;
+    emit(fp, binary, uniform01() * 100 < calloc_pct ? CALLOC : ALLOC, id, size);
+}
+
+/*
+ * try_realloc - Grow a random live block, if that keeps the live bytes
+ *     within the peak. Returns 1 if it did.
+ */
+static int try_realloc(FILE *fp, int binary)
+{
+    live_t *b = &heap[random64() % num_live];
+    long long size = grow_add ? b->size + (long long)grow_by : (long long)(b->size * grow_by);
+
+    if (size > INT_MAX || live + size - b->size > peak_limit)
+        return 0;
+    if (size < 1)
+        size = 1;
+    live += size - b->size;
+    b->size = size;
+    emit(fp, binary, REALLOC, b->id, size);
+    return 1;
+}
+
+/*
+ * generate - Make the whole trace, writing it to fp unless fp is NULL,
+ *     and fill in hdr
+ */
+static void generate(FILE *fp, int binary, unsigned long long seed, trace_hdr_t *hdr)
+{
+    long long now, pending = 0;
+
+    rng = seed;
+    num_live = num_free_ids = num_ids = 0;
+    live = peak = 0;
+    buf_used = 0;
+
+    for (now = 0; now < num_ops; now++) {
+        if (num_live > 0 && (num_live >= num_ops - now || heap[0].death <= now)) {
+            free_first(fp, binary);
+            continue;
+        }
+        if (num_live > 0 && realloc_pct > 0 && uniform01() * 100 < realloc_pct &&
+            try_realloc(fp, binary))
+            continue;
+        if (pending == 0)
+            pending = draw(&size_dist);
+        if (pending > INT_MAX)
+            pending = INT_MAX;
+        if (num_live > 0 && live + pending > peak_limit) {
+            free_first(fp, binary);
+            continue;
+        }
+        allocate(fp, binary, (int)pending, now);
+        pending = 0;
+    }
+
+    if (fp != NULL && buf_used > 0 &&
+        (binary ? trace_write_bin_ops(fp, buf, buf_used) :
+         trace_write_rep_ops(fp, buf, buf_used)) < 0) {
+        perror("gentrace");
+        exit(1);
+    }
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic));
+    hdr->version = TRACE_VERSION;
+    hdr->sugg_heapsize = peak > INT_MAX ? INT_MAX : (int)peak;
+    hdr->num_ids = num_ids;
+    hdr->num_ops = (int)num_ops;
+    hdr->weight = 1;
+}
+
+/*
+ * parse_bytes - Returns the byte count in s, which may end in k, m or g,
+ *     or -1 if s is not one
+ */
+static double parse_bytes(const char *s, char **end)
+{
+    double x = strtod(s, end);
+
+    switch (**end) {
+    case 'k': case 'K': x *= 1 << 10; (*end)++; break;
+    case 'm': case 'M': x *= 1 << 20; (*end)++; break;
+    case 'g': case 'G': x *= 1 << 30; (*end)++; break;
+    }
+    return *end == s ? -1 : x;
+}
+
+/*
+ * parse_dist - Parse the distribution in s into *dist.
+ *     Returns 0, or -1 if s is not a distribution.
+ */
+static int parse_dist(const char *s, dist_t *dist)
+{
+    static const struct { const char *name; dist_kind_t kind; int nargs; } kinds[] = {
+        {"fixed", D_FIXED, 1}, {"uniform", D_UNIFORM, 2}, {"power", D_POWER, 3},
+        {"bimodal", D_BIMODAL, 3}, {"exp", D_EXP, 1}
+    };
+    double args[3] = {0, 0, 0};
+    const char *colon = strchr(s, ':');
+    char *end = NULL;
+    size_t i;
+    int n;
+
+    if (colon == NULL)
+        return -1;
+    for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+        if (strlen(kinds[i].name) == (size_t)(colon - s) &&
+            strncmp(s, kinds[i].name, colon - s) == 0)
+            break;
+    if (i == sizeof(kinds) / sizeof(kinds[0]))
+        return -1;
+    for (n = 0; n < kinds[i].nargs; n++) {
+        if (*colon != ':')
+            return -1;
+        /* the last argument of power and bimodal is not a byte count */
+        if (n == 2)
+            args[n] = strtod(colon + 1, &end);
+        else
+            args[n] = parse_bytes(colon + 1, &end);
+        if (end == colon + 1 || args[n] < 0)
+            return -1;
+        colon = end;
+    }
+    if (*end != '\0')
+        return -1;
+    dist->kind = kinds[i].kind;
+    dist->a = args[0];
+    dist->b = args[1];
+    dist->c = args[2];
+    if ((dist->kind == D_UNIFORM || dist->kind == D_POWER) &&
+        (dist->a < 1 || dist->b < dist->a))
+        return -1;
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-b] [-n <ops>] [-s <dist>] [-l <dist>] [-r <pct>]\n"
+            "       [-g mul:<factor>|add:<bytes>] [-c <pct>] [-p <bytes>] [-S <seed>] <out>\n"
+            "  -b  write the binary format\n"
+            "  -n  number of requests (default 1000000)\n"
+            "  -s  block sizes (default power:16:4096:1.2)\n"
+            "  -l  block lifetimes, in requests (default exp:1000)\n"
+            "  -r  percent of requests that grow a live block with realloc (default 0)\n"
+            "  -g  how realloc grows a block (default mul:1.5)\n"
+            "  -c  percent of allocations made with calloc (default 0)\n"
+            "  -p  most live bytes at any time (default 64m)\n"
+            "  -S  random seed (default 1)\n"
+            "distributions: fixed:<n> uniform:<lo>:<hi> power:<lo>:<hi>:<alpha>\n"
+            "               bimodal:<a>:<b>:<pct> exp:<mean>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int binary = 0, c;
+    unsigned long long seed = 1;
+    trace_hdr_t hdr;
+    char *end;
+    double x;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "bhn:s:l:r:g:c:p:S:")) != EOF) {
+        switch (c) {
+        case 'b':
+            binary = 1;
+            break;
+        case 'n':
+            x = strtod(optarg, &end);
+            if (*end != '\0' || x < 0 || x > INT_MAX)
+                usage(argv[0]);
+            num_ops = (long long)x;
+            break;
+        case 's':
+            if (parse_dist(optarg, &size_dist) < 0)
+                usage(argv[0]);
+            break;
+        case 'l':
+            if (parse_dist(optarg, &life_dist) < 0)
+                usage(argv[0]);
+            break;
+        case 'r':
+            realloc_pct = atof(optarg);
+            break;
+        case 'g':
+            if (strncmp(optarg, "mul:", 4) == 0) {
+                grow_add = 0;
+                grow_by = strtod(optarg + 4, &end);
+            } else if (strncmp(optarg, "add:", 4) == 0) {
+                grow_add = 1;
+                grow_by = parse_bytes(optarg + 4, &end);
+            } else {
+                usage(argv[0]);
+            }
+            if (*end != '\0' || grow_by < 0)
+                usage(argv[0]);
+            break;
+        case 'c':
+            calloc_pct = atof(optarg);
+            break;
+        case 'p':
+            if ((x = parse_bytes(optarg, &end)) < 1 || *end != '\0')
+                usage(argv[0]);
+            peak_limit = (long long)x;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1)
+        usage(argv[0]);
+
+    /* A first pass to fill in the header, then one to write the ops */
+    generate(NULL, binary, seed, &hdr);
+    if ((fp = fopen(argv[optind], binary ? "wb" : "w")) == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if ((binary ? trace_write_bin_hdr(fp, &hdr) : trace_write_rep_hdr(fp, &hdr)) < 0) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    generate(fp, binary, seed, &hdr);
+    if (fclose(fp) != 0) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    printf("%d requests on %d ids, peak %d bytes\n",
+           hdr.num_ops, hdr.num_ids, hdr.sugg_heapsize);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * heapsnap.c - write and read the heap snapshot files described in
+ *     heapsnap.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heapsnap.h"
+
+/*
+ * snap_write_hdr - Write the magic number and version
+ */
+int snap_write_hdr(FILE *fp)
+{
+    snap_hdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAP_VERSION;
+    return fwrite(&hdr, sizeof(hdr), 1, fp) == 1 ? 0 : -1;
+}
+
+/*
+ * snap_write_trace - Write the record header, then the name
+ */
+int snap_write_trace(FILE *fp, const char *name)
+{
+    snap_rec_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = SNAP_TRACE;
+    rec.name_len = strlen(name);
+    if (fwrite(&rec, sizeof(rec), 1, fp) != 1 ||
+        fwrite(name, 1, rec.name_len, fp) != rec.name_len)
+        return -1;
+    return 0;
+}
+
+/*
+ * snap_write_heap - Write the record header, then the blocks
+ */
+int snap_write_heap(FILE *fp, snap_rec_t *rec, const uint32_t *blocks)
+{
+    rec->type = SNAP_HEAP;
+    rec->name_len = 0;
+    if (fwrite(rec, sizeof(*rec), 1, fp) != 1 ||
+        fwrite(blocks, sizeof(uint32_t), rec->num_blocks, fp) != rec->num_blocks)
+        return -1;
+    return 0;
+}
+
+/*
+ * snap_read_hdr - Check the magic number and version
+ */
+int snap_read_hdr(FILE *fp, const char *path)
+{
+    snap_hdr_t hdr;
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s is not a heap snapshot file\n", path);
+        return -1;
+    }
+    if (hdr.version != SNAP_VERSION) {
+        fprintf(stderr, "%s has snapshot version %u, expected %d\n",
+                path, hdr.version, SNAP_VERSION);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * corrupt - Report a snapshot file that ends or goes wrong mid-record
+ */
+static int corrupt(const char *path)
+{
+    fprintf(stderr, "%s is truncated or corrupt\n", path);
+    return -1;
+}
+
+/*
+ * snap_read - Read a record header, then as much data as it announces
+ */
+int snap_read(FILE *fp, const char *path, snap_rec_t *rec, void **data, size_t *cap)
+{
+    size_t n, len;
+
+    if ((n = fread(rec, 1, sizeof(*rec), fp)) != sizeof(*rec))
+        return n == 0 && !ferror(fp) ? 0 : corrupt(path);
+    if (rec->type == SNAP_TRACE)
+        len = rec->name_len + 1;
+    else if (rec->type == SNAP_HEAP && rec->num_blocks <= SIZE_MAX / sizeof(uint32_t))
+        len = rec->num_blocks * sizeof(uint32_t);
+    else
+        return corrupt(path);
+
+    if (len > *cap) {
+        if ((*data = realloc(*data, len)) == NULL) {
+            fprintf(stderr, "out of memory reading %s\n", path);
+            return -1;
+        }
+        *cap = len;
+    }
+    if (rec->type == SNAP_TRACE) {
+        if (fread(*data, 1, rec->name_len, fp) != rec->name_len)
+            return corrupt(path);
+        ((char *)*data)[rec->name_len] = '\0';
+    } else if (fread(*data, sizeof(uint32_t), rec->num_blocks, fp) != rec->num_blocks)
+        return corrupt(path);
+    return 1;
+}
@@ -0,0 +1,85 @@
+/*
+ * heapsnap.h - the format of the heap snapshots written by mdriver -S
+ *
+ * A snapshot file is a snap_hdr_t followed by records, in host byte
+ * order. Each record is a snap_rec_t and its data. A SNAP_TRACE record
+ * starts the snapshots of a trace, and is followed by the trace's name
+ * (name_len bytes, not NUL-terminated). A SNAP_HEAP record is one
+ * snapshot, taken after op of the trace's num_ops requests, and is
+ * followed by num_blocks block words: the size and allocated bit of
+ * every block of the heap in address order. The blocks are contiguous,
+ * so the first lies at offset first from the bottom of the heap, and
+ * each of the others right after the one before. heapviz renders them.
+ */
+#ifndef __HEAPSNAP_H_
+#define __HEAPSNAP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* First bytes of a snapshot file, and the version of its layout */
+#define SNAP_MAGIC    "MMSNAPS"   /* 8 bytes with the terminating NUL */
+#define SNAP_VERSION  1
+
+/* Types of records */
+enum {SNAP_TRACE = 1, SNAP_HEAP = 2};
+
+/* A block word holds the block's size, which is even, and 1 if it is allocated */
+#define SNAP_WORD(size, alloc)  ((uint32_t)(size) | ((alloc) ? 1 : 0))
+#define SNAP_SIZE(word)         ((word) & ~(uint32_t)1)
+#define SNAP_ALLOC(word)        ((word) & 1)
+
+/* The header of a snapshot file */
+typedef struct {
+    char magic[8];          /* SNAP_MAGIC */
+    uint32_t version;       /* SNAP_VERSION */
+    uint32_t reserved;      /* zero; pads the header to 16 bytes */
+} snap_hdr_t;
+
+/* The header of a record; the fields not used by its type are zero */
+typedef struct {
+    uint32_t type;          /* SNAP_TRACE or SNAP_HEAP */
+    uint32_t name_len;      /* SNAP_TRACE: bytes of the name that follow */
+    uint64_t op;            /* requests of the trace replayed so far */
+    uint64_t num_ops;       /* requests in the trace */
+    uint64_t heap_size;     /* bytes of heap (mem_heapsize) */
+    uint64_t live_bytes;    /* bytes the trace asked for and has not freed */
+    uint64_t first;         /* offset of the first block from the bottom of the heap */
+    uint64_t num_blocks;    /* SNAP_HEAP: block words that follow */
+} snap_rec_t;
+
+/*
+ * snap_write_hdr - Write the header of a snapshot file to fp.
+ *     Returns 0, or -1 if the write failed.
+ */
+int snap_write_hdr(FILE *fp);
+
+/*
+ * snap_write_trace - Write a SNAP_TRACE record for the trace called name.
+ *     Returns 0, or -1 if the write failed.
+ */
+int snap_write_trace(FILE *fp, const char *name);
+
+/*
+ * snap_write_heap - Write a SNAP_HEAP record: *rec (with its type and
+ *     name_len filled in here) and its rec->num_blocks block words.
+ *     Returns 0, or -1 if the write failed.
+ */
+int snap_write_heap(FILE *fp, snap_rec_t *rec, const uint32_t *blocks);
+
+/*
+ * snap_read_hdr - Read and check the header of the snapshot file in fp
+ *     (named path in messages).
+ *     Returns 0, or -1 after printing an error.
+ */
+int snap_read_hdr(FILE *fp, const char *path);
+
+/*
+ * snap_read - Read the next record into *rec, and its data into *data,
+ *     a malloc'd buffer of *cap bytes that is grown as needed (start with
+ *     NULL and 0). The name of a SNAP_TRACE record is NUL-terminated.
+ *     Returns 1, 0 at the end of the file, or -1 after printing an error.
+ */
+int snap_read(FILE *fp, const char *path, snap_rec_t *rec, void **data, size_t *cap);
+
+#endif /* __HEAPSNAP_H_ */
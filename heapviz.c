@@ -0,0 +1,294 @@
+/*
+ * heapviz.c - render the heap snapshots written by mdriver -S
+ *
+ * usage: heapviz [-c] [-t <trace>] [-n <rows>] [-w <width>] <snaps>
+ *
+ * For each trace, prints one line per snapshot (up to -n evenly spaced
+ * ones) with the heap size, the bytes the trace has live, the free bytes
+ * and blocks, the largest free block, the external fragmentation (the
+ * share of the free bytes outside the largest free block) and a picture
+ * of the heap, -w columns wide on the scale of the trace's largest heap:
+ * '#' for a column of allocated blocks, '+' mostly allocated, '-' mostly
+ * free, '.' free and ' ' past the end of the heap. The first snapshot at
+ * the largest heap, which is what utilization is measured against, is
+ * always shown, and followed by a histogram of its free block sizes: the
+ * memory that was free but did not spare the heap its last growth. -t
+ * keeps the traces whose name contains <trace>, and -c prints the numbers
+ * of every snapshot as CSV instead.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "heapsnap.h"
+
+#define MAX_WIDTH  256  /* largest -w */
+#define NUM_BINS    33  /* free block size bins, [2^i, 2^(i+1)) bytes */
+#define BAR_WIDTH   40  /* width of the histogram bars */
+
+/* What one snapshot comes to */
+typedef struct {
+    uint64_t free_bytes;     /* bytes in free blocks */
+    uint64_t free_blocks;    /* number of free blocks */
+    uint64_t largest;        /* size of the largest free block */
+    uint64_t bins[NUM_BINS]; /* free blocks in each size bin */
+    uint64_t bin_bytes[NUM_BINS];
+    char layout[MAX_WIDTH + 1];
+} summary_t;
+
+/* What pass 1 learns of each trace */
+typedef struct {
+    int snaps;               /* number of snapshots */
+    uint64_t peak;           /* largest heap_size */
+} trace_info_t;
+
+static int width = 64;
+
+/*
+ * util - Share of the heap the live bytes of a snapshot fill
+ */
+static double util(const snap_rec_t *rec)
+{
+    return rec->heap_size > 0 ? (double)rec->live_bytes / rec->heap_size : 0;
+}
+
+/*
+ * summarize - Total up the free blocks of a snapshot, and draw its
+ *     layout with columns of col bytes each
+ */
+static void summarize(const snap_rec_t *rec, const uint32_t *words, uint64_t col,
+                      summary_t *sum)
+{
+    static uint64_t alloc[MAX_WIDTH], cover[MAX_WIDTH];
+    uint64_t off, end, size, lo, hi, n;
+    size_t i;
+    int c, b;
+
+    memset(sum, 0, sizeof(*sum));
+    memset(alloc, 0, sizeof(alloc));
+    memset(cover, 0, sizeof(cover));
+
+    /* The bytes below the first block (the mm package's own data) count
+     * as allocated */
+    for (i = 0, off = 0; i <= rec->num_blocks; i++, off = end) {
+        if (i == 0) {
+            end = rec->first;
+            size = end;
+            b = 1;
+        } else {
+            size = SNAP_SIZE(words[i - 1]);
+            end = off + size;
+            b = SNAP_ALLOC(words[i - 1]);
+            if (!b) {
+                sum->free_bytes += size;
+                sum->free_blocks++;
+                if (size > sum->largest)
+                    sum->largest = size;
+                for (c = 0; c < NUM_BINS - 1 && size >> (c + 1) > 0; c++)
+                    ;
+                sum->bins[c]++;
+                sum->bin_bytes[c] += size;
+            }
+        }
+        for (lo = off; lo < end && lo / col < (uint64_t)width; lo = hi) {
+            c = lo / col;
+            hi = (c + 1) * col < end ? (c + 1) * col : end;
+            n = hi - lo;
+            cover[c] += n;
+            if (b)
+                alloc[c] += n;
+        }
+    }
+    for (c = 0; c < width; c++) {
+        if (cover[c] == 0)
+            sum->layout[c] = ' ';
+        else if (alloc[c] == cover[c])
+            sum->layout[c] = '#';
+        else if (2 * alloc[c] >= cover[c])
+            sum->layout[c] = '+';
+        else if (alloc[c] > 0)
+            sum->layout[c] = '-';
+        else
+            sum->layout[c] = '.';
+    }
+    sum->layout[width] = '\0';
+}
+
+/*
+ * print_row - One line of the table of a trace
+ */
+static void print_row(const snap_rec_t *rec, const summary_t *sum, int peak)
+{
+    printf("%10lu %8lu %8lu %4.0f%% %8lu %7lu %9lu ",
+           (unsigned long)rec->op, (unsigned long)(rec->heap_size / 1024),
+           (unsigned long)(rec->live_bytes / 1024), 100 * util(rec),
+           (unsigned long)(sum->free_bytes / 1024), (unsigned long)sum->free_blocks,
+           (unsigned long)(sum->largest / 1024));
+    if (sum->free_bytes > 0)
+        printf("%4.0f%%", 100.0 * (sum->free_bytes - sum->largest) / sum->free_bytes);
+    else
+        printf("%5s", "-");
+    printf("  |%s|%s\n", sum->layout, peak ? " <- largest heap" : "");
+}
+
+/*
+ * print_histogram - The free block sizes of a snapshot, with bars
+ *     proportional to the bytes in each bin
+ */
+static void print_histogram(const snap_rec_t *rec, const summary_t *sum)
+{
+    uint64_t most = 0;
+    int c, lo = -1, hi = -1;
+    char range[32];
+
+    printf("\nFree blocks after request %lu (utilization %.0f%%):\n",
+           (unsigned long)rec->op, 100 * util(rec));
+    for (c = 0; c < NUM_BINS; c++) {
+        if (sum->bins[c] > 0) {
+            if (lo < 0)
+                lo = c;
+            hi = c;
+        }
+        if (sum->bin_bytes[c] > most)
+            most = sum->bin_bytes[c];
+    }
+    if (lo < 0) {
+        printf("  none\n");
+        return;
+    }
+    printf("  %-22s %9s %9s\n", "size (bytes)", "blocks", "KB");
+    for (c = lo; c <= hi; c++) {
+        snprintf(range, sizeof(range), "%lu-%lu", 1UL << c, (2UL << c) - 1);
+        printf("  %-22s %9lu %9.1f  ", range, (unsigned long)sum->bins[c],
+               sum->bin_bytes[c] / 1024.0);
+        printf("%.*s\n", (int)(BAR_WIDTH * sum->bin_bytes[c] / most),
+               "########################################");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int csv = 0, rows = 25, c, ntraces = 0, maxtraces = 0, t, k, r, peak_k = 0;
+    char *only = NULL, *name = NULL;
+    trace_info_t *info = NULL;
+    snap_rec_t rec, peak_rec;
+    summary_t sum, peak_sum;
+    void *data = NULL;
+    size_t cap = 0;
+    uint64_t col = 1;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "ct:n:w:")) != EOF) {
+        switch (c) {
+        case 'c':
+            csv = 1;
+            break;
+        case 't':
+            only = optarg;
+            break;
+        case 'n':
+            rows = atoi(optarg);
+            break;
+        case 'w':
+            width = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    }
+    if (argc - optind != 1 || rows < 1 || width < 1 || width > MAX_WIDTH) {
+        fprintf(stderr, "usage: %s [-c] [-t <trace>] [-n <rows>] [-w <width 1-%d>] <snaps>\n",
+                argv[0], MAX_WIDTH);
+        exit(1);
+    }
+    if ((fp = fopen(argv[optind], "rb")) == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+
+    /* Pass 1: count the snapshots of each trace, and find its largest heap */
+    if (snap_read_hdr(fp, argv[optind]) < 0)
+        exit(1);
+    while ((r = snap_read(fp, argv[optind], &rec, &data, &cap)) > 0) {
+        if (rec.type == SNAP_TRACE) {
+            if (ntraces == maxtraces) {
+                maxtraces = maxtraces ? 2 * maxtraces : 64;
+                if ((info = realloc(info, maxtraces * sizeof(trace_info_t))) == NULL) {
+                    fprintf(stderr, "heapviz: out of memory\n");
+                    exit(1);
+                }
+            }
+            memset(&info[ntraces++], 0, sizeof(trace_info_t));
+            continue;
+        }
+        if (ntraces == 0) {
+            fprintf(stderr, "%s: snapshot before any trace\n", argv[optind]);
+            exit(1);
+        }
+        info[ntraces - 1].snaps++;
+        if (rec.heap_size > info[ntraces - 1].peak)
+            info[ntraces - 1].peak = rec.heap_size;
+    }
+    if (r < 0)
+        exit(1);
+
+    /* Pass 2: print them */
+    rewind(fp);
+    snap_read_hdr(fp, argv[optind]);
+    if (csv)
+        printf("trace,op,heap,live,free,free_blocks,largest_free\n");
+    t = -1;
+    k = 0;
+    while ((r = snap_read(fp, argv[optind], &rec, &data, &cap)) > 0) {
+        if (rec.type == SNAP_TRACE) {
+            if (!csv && peak_k > 0)
+                print_histogram(&peak_rec, &peak_sum);
+            t++;
+            k = 0;
+            peak_k = 0;
+            free(name);
+            name = strdup(data);
+            if (only != NULL && strstr(name, only) == NULL)
+                continue;
+            col = info[t].peak / width + 1;
+            if (!csv) {
+                printf("%s%s: %d snapshots, largest heap %lu KB\n", t > 0 ? "\n" : "",
+                       name, info[t].snaps, (unsigned long)(info[t].peak / 1024));
+                if (info[t].snaps > 0)
+                    printf("%10s %8s %8s %5s %8s %7s %9s %5s  heap (%lu KB per column)\n",
+                           "request", "heapKB", "liveKB", "util", "freeKB", "free",
+                           "maxfreeKB", "frag", (unsigned long)((col + 1023) / 1024));
+            }
+            continue;
+        }
+        k++;
+        if (only != NULL && strstr(name, only) == NULL)
+            continue;
+        summarize(&rec, data, col, &sum);
+        if (csv) {
+            printf("%s,%lu,%lu,%lu,%lu,%lu,%lu\n", name, (unsigned long)rec.op,
+                   (unsigned long)rec.heap_size, (unsigned long)rec.live_bytes,
+                   (unsigned long)sum.free_bytes, (unsigned long)sum.free_blocks,
+                   (unsigned long)sum.largest);
+            continue;
+        }
+        if (peak_k == 0 && rec.heap_size == info[t].peak) {
+            peak_k = k;
+            peak_rec = rec;
+            peak_sum = sum;
+        }
+        /* Show rows evenly spaced snapshots, the last one among them, and
+         * the first at the largest heap */
+        if ((long)k * rows / info[t].snaps != (long)(k - 1) * rows / info[t].snaps ||
+            k == peak_k)
+            print_row(&rec, &sum, k == peak_k);
+    }
+    if (r == 0 && !csv && peak_k > 0)
+        print_histogram(&peak_rec, &peak_sum);
+
+    free(name);
+    free(data);
+    free(info);
+    fclose(fp);
+    return r < 0;
+}
@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE  /* pthread_setaffinity_np */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,12 +15,18 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "tracefmt.h"
+#include "profile.h"
+#include "heapsnap.h"
 
 /**********************
  * Constants and macros
@@ -33,31 +40,42 @@
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
+/* Returns true if p is aligned as an alloc request with alignment align
+ * (0 for the default) requires */
+#define IS_ALIGNED_TO(p, align)  (IS_ALIGNED(p) && ((align) == 0 || ((size_t)(p)) % (align) == 0))
+
+/* Does alloc request op need more than the default alignment? */
+#define OP_ALIGNED(op)  ((op).align > ALIGNMENT)
+
+/* Multi-threaded replay */
+#define MAX_THREADS  256 /* max value of -T */
+#define MT_RUNS        3 /* replays per trace; the fastest one is reported */
+
+/* Heap snapshots (-S) */
+#define SNAPSHOTS    100 /* taken at even intervals over each trace */
+
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a node of an AVL tree
+ * ordered by low address */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* subtree of ranges with lower addresses */
+    struct range_t *right; /* subtree of ranges with higher addresses */
+    int height;            /* height of the subtree rooted here */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
+    const traceop_t *ops; /* array of requests */
+    size_t maplen;       /* length of the mapping ops is in, or 0 if malloc'd */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
@@ -72,15 +90,80 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* The ways the -T replay distributes a trace over the threads */
+typedef enum {
+    MT_COPY,   /* every thread replays its own copy of the whole trace */
+    MT_SPLIT,  /* ids are dealt out over the threads, frees cross threads */
+    MT_PIPE    /* pairs of threads: one allocates, the other frees */
+} mt_mode_t;
+
+/* Names of the modes, as given to -m */
+static const char *mt_mode_names[] = {"copy", "split", "pipe"};
+
+/* The allocator a replay thread exercises */
+typedef struct {
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*memalign)(size_t align, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+} allocator_t;
+
+/* State shared by all threads of one multi-threaded replay */
+typedef struct {
+    trace_t *trace;
+    const allocator_t *alloc;
+    mt_mode_t mode;
+    int nthreads;
+    pthread_barrier_t barrier; /* lines the threads up before timing */
+    int *versions;             /* split: requests done so far, per id */
+    int *wait_for;             /* split: versions[id] each request must wait for */
+    int failed;                /* set when an allocation fails; threads give up
+                                  (accessed atomically while they run) */
+} mt_run_t;
+
+/* Parameters and results of one replay thread */
+typedef struct {
+    mt_run_t *run;
+    int tid;                   /* thread number, 0..nthreads-1 */
+    char **blocks;             /* block pointers this thread works with */
+    int ops;                   /* number of requests this thread issued */
+    double start, end;         /* when the thread started and finished */
+} mt_thread_t;
+
+/* Summarizes one multi-threaded replay of a trace */
+typedef struct {
+    double ops;      /* number of requests issued by all threads */
+    double secs;     /* wall time from the first start to the last finish */
+    double min_kops; /* slowest thread (Kops/sec) */
+    double avg_kops; /* average over the threads (Kops/sec) */
+    double max_kops; /* fastest thread (Kops/sec) */
+    unsigned long remote; /* mm frees that found the heap locked, in the best run */
+    int valid;       /* did every run complete without a failed allocation? */
+} mt_stats_t;
+
+/* The profile of the mm package on one trace, recorded by -P */
+typedef struct {
+    hist_t latency[4];                /* ns per call, indexed by ALLOC/FREE/REALLOC/CALLOC */
+    long long counters[NUM_COUNTERS]; /* events in one replay (-1 if unavailable) */
+    int valid;                        /* was the trace profiled? */
+} prof_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double ci;       /* half-width of a 95% confidence interval for secs (0 if unknown) */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    size_t peak;     /* largest heap size during the trace (0 for libc) */
+    size_t final;    /* heap size once the trace is done (0 for libc) */
+    unsigned long extensions; /* times the heap grew during the trace */
+    unsigned long reallocs;   /* blocks resized by mm_realloc */
+    unsigned long moves;      /* of those, blocks that had to be copied */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -91,10 +174,23 @@ typedef struct {
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
+static int pin_threads = 0; /* pin -T replay threads to CPUs (set by -N local) */
+
+/* The allocators the multi-threaded replay can drive */
+static const allocator_t libc_allocator = {malloc, free, realloc, aligned_alloc, calloc};
+static const allocator_t mm_allocator = {mm_malloc, mm_free, mm_realloc, mm_memalign, mm_calloc};
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Heap snapshots (-S): where they go, whether eval_mm_util takes them,
+ * and the block words of the one being taken */
+static FILE *snapfp = NULL;
+static int snapping = 0;
+static uint32_t *snap_blocks = NULL;
+static size_t snap_count, snap_max;
+static char *snap_first;
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
                                      DEFAULT_TRACEFILES, NULL
@@ -105,11 +201,16 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate range trees */
+static int add_range(range_t **ranges, char *lo, int size, int align,
                      int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *find_range(range_t *ranges, char *addr);
+static range_t *insert_range(range_t *ranges, range_t *p);
+static range_t *delete_range(range_t *ranges, char *lo);
+static range_t *balance_range(range_t *p);
+static range_t *rotate_range(range_t *p, int right);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
@@ -122,11 +223,32 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm(trace_t *trace, int tracenum, range_t **ranges, 
+                    stats_t *stats);
+static void snap_visit(void *bp, size_t size, int alloc, void *arg);
+static void snapshot(int op, int num_ops, size_t live);
+
+/* Routines for replaying a trace on several threads at once */
+static void eval_mt_speed(trace_t *trace, const allocator_t *alloc,
+                          mt_mode_t mode, int nthreads, mt_stats_t *stats);
+static void *mt_thread(void *ptr);
+static void printmtresults(int n, char **tracefiles, mt_stats_t *mm_mt,
+                           mt_stats_t *libc_mt, int nthreads, mt_mode_t mode);
+
+/* Routines for profiling the mm package (-P) */
+static void eval_mm_profile(trace_t *trace, counters_t *counters, prof_t *prof);
+static void printprofresults(int n, char **tracefiles, prof_t *prof,
+                             stats_t *stats, const counters_t *counters,
+                             int ncounters);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcompareresults(int n, stats_t *base, stats_t *other,
+                                char *base_name, char *other_name);
+static void writecsv(char *filename, int n, char **tracefiles, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -145,11 +267,30 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *defer_stats = NULL; /* mm stats with deferred coalescing (-D) */
+    stats_t *noroom_stats = NULL; /* mm stats without realloc headroom (-R) */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int nthreads = 0;    /* If set, also replay on this many threads (-T) */
+    mt_mode_t mt_mode = MT_COPY; /* how -T spreads a trace over threads (-m) */
+    mt_stats_t *mm_mt = NULL;    /* mm multi-threaded stats for each trace */
+    mt_stats_t *libc_mt = NULL;  /* libc multi-threaded stats for each trace */
+    int profile = 0;             /* If set, profile the mm package (-P) */
+    int defer = 0;               /* If set, also try deferred coalescing (-D) */
+    int noroom = 0;              /* If set, also try without realloc headroom (-R) */
+    int fresh = 0;               /* If set, every run starts on fresh pages (-F) */
+    char *csvfile = NULL;        /* If set, write the mm results there as CSV (-o) */
+    char *snapfile = NULL;       /* If set, write heap snapshots there (-S) */
+    int pages = MEM_PAGES_SMALL; /* what pages back the heap (-H) */
+    int numa = MEM_NUMA_FIRST_TOUCH; /* where the heap's pages go (-N) */
+    int timing_cpu = -1;         /* If set, run on this CPU only (-C) */
+    cpu_set_t cpus;
+    prof_t *mm_prof = NULL;      /* mm profile for each trace */
+    counters_t counters;         /* hardware counters for the profile */
+    int ncounters;               /* how many of them could be opened */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,21 +299,20 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:o:hvVgalT:m:PDRFH:N:C:S:")) != EOF) {
         switch (c) {
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
             break;
-        case 'f': /* Use one specific trace file only (relative to curr dir) */
-            num_tracefiles = 1;
-            if ((tracefiles = realloc(tracefiles, 2*sizeof(char *))) == NULL)
+        case 'f': /* Use specific trace files only (relative to curr dir) */
+            if ((tracefiles = realloc(tracefiles, (num_tracefiles+2)*sizeof(char *))) == NULL)
                 unix_error("ERROR: realloc failed in main");
             strcpy(tracedir, "./"); 
-            tracefiles[0] = strdup(optarg);
-            tracefiles[1] = NULL;
+            tracefiles[num_tracefiles++] = strdup(optarg);
+            tracefiles[num_tracefiles] = NULL;
             break;
         case 't': /* Directory where the traces are located */
-            if (num_tracefiles == 1) /* ignore if -f already encountered */
+            if (num_tracefiles > 0) /* ignore if -f already encountered */
                 break;
             strcpy(tracedir, optarg);
             if (tracedir[strlen(tracedir)-1] != '/') 
@@ -184,6 +324,75 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'T': /* Also replay each trace on several threads */
+            nthreads = atoi(optarg);
+            if (nthreads < 1 || nthreads > MAX_THREADS) {
+                fprintf(stderr, "-T expects 1 to %d threads\n", MAX_THREADS);
+                exit(1);
+            }
+            break;
+        case 'm': /* How the -T replay distributes a trace */
+            if (!strcmp(optarg, "copy"))
+                mt_mode = MT_COPY;
+            else if (!strcmp(optarg, "split"))
+                mt_mode = MT_SPLIT;
+            else if (!strcmp(optarg, "pipe"))
+                mt_mode = MT_PIPE;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'P': /* Profile latencies and hardware events */
+            profile = 1;
+            break;
+        case 'D': /* Also evaluate mm with deferred coalescing */
+            defer = 1;
+            break;
+        case 'R': /* Also evaluate mm without realloc headroom */
+            noroom = 1;
+            break;
+        case 'C': /* Pin the driver to one CPU while it times */
+            timing_cpu = atoi(optarg);
+            if (timing_cpu < 0 || timing_cpu >= CPU_SETSIZE) {
+                fprintf(stderr, "-C expects a CPU number\n");
+                exit(1);
+            }
+            break;
+        case 'S': /* Write heap snapshots to a file */
+            snapfile = optarg;
+            break;
+        case 'F': /* Give the heap's pages back between runs */
+            fresh = 1;
+            break;
+        case 'H': /* Back the heap with huge pages */
+            if (!strcmp(optarg, "none"))
+                pages = MEM_PAGES_SMALL;
+            else if (!strcmp(optarg, "thp"))
+                pages = MEM_PAGES_THP;
+            else if (!strcmp(optarg, "hugetlb"))
+                pages = MEM_PAGES_HUGETLB;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'N': /* Where the heap's pages go on a NUMA machine */
+            if (!strcmp(optarg, "first"))
+                numa = MEM_NUMA_FIRST_TOUCH;
+            else if (!strcmp(optarg, "local"))
+                numa = MEM_NUMA_LOCAL;
+            else if (!strcmp(optarg, "interleave"))
+                numa = MEM_NUMA_INTERLEAVE;
+            else {
+                usage();
+                exit(1);
+            }
+            pin_threads = (numa == MEM_NUMA_LOCAL);
+            break;
+        case 'o': /* Write the mm results to a CSV file */
+            csvfile = optarg;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -235,7 +444,15 @@ int main(int argc, char **argv)
         printf("Using default tracefiles in %s\n", tracedir);
     }
 
-    /* Initialize the timing package */
+    /* Initialize the timing package. With -C, the driver stays on one
+     * CPU, so that migrations and cold caches on a new CPU do not end up
+     * in the samples */
+    if (timing_cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(timing_cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+            unix_error("Could not pin the driver to the -C CPU");
+    }
     init_fsecs();
 
     /*
@@ -262,6 +479,7 @@ int main(int argc, char **argv)
                 if (verbose > 1)
                     printf("and performance.\n");
                 libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                libc_stats[i].ci = fsecs_ci();
             }
             free_trace(trace);
         }
@@ -285,27 +503,54 @@ int main(int argc, char **argv)
         unix_error("mm_stats calloc in main failed");
     
     /* Initialize the simulated memory system in memlib.c */
+    mem_use_hugepages(pages);
+    mem_set_numa(numa);
     mem_init(); 
+    mem_release_on_reset(fresh);
+
+    /* With -D, each trace is also run with deferred coalescing, right
+     * after the default run, so that both see the same conditions */
+    if (defer && (defer_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+        unix_error("defer_stats calloc in main failed");
+    if (noroom && (noroom_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+        unix_error("noroom_stats calloc in main failed");
+
+    /* With -S, the default run of each trace also snapshots the heap */
+    if (snapfile != NULL &&
+        ((snapfp = fopen(snapfile, "wb")) == NULL || snap_write_hdr(snapfp) < 0))
+        unix_error("Could not write the -S snapshot file");
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
         trace = read_trace(tracedir, tracefiles[i]);
-        mm_stats[i].ops = trace->num_ops;
-        if (verbose > 1)
-            printf("Checking mm_malloc for correctness, ");
-        mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-        if (mm_stats[i].valid) {
+        if (snapfp != NULL) {
+            if (snap_write_trace(snapfp, tracefiles[i]) < 0)
+                unix_error("Could not write the -S snapshot file");
+            snapping = 1;
+        }
+        eval_mm(trace, i, &ranges, &mm_stats[i]);
+        snapping = 0;
+        if (defer) {
             if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-            speed_params.trace = trace;
-            speed_params.ranges = ranges;
+                printf("With deferred coalescing: ");
+            mm_defer_coalescing(1);
+            eval_mm(trace, i, &ranges, &defer_stats[i]);
+            mm_defer_coalescing(0);
+        }
+        if (noroom) {
             if (verbose > 1)
-                printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+                printf("Without realloc headroom: ");
+            mm_realloc_headroom(0);
+            eval_mm(trace, i, &ranges, &noroom_stats[i]);
+            mm_realloc_headroom(1);
         }
         free_trace(trace);
     }
+    if (snapfp != NULL) {
+        if (fclose(snapfp) != 0)
+            unix_error("Could not write the -S snapshot file");
+        free(snap_blocks);
+    }
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -313,6 +558,89 @@ int main(int argc, char **argv)
         printresults(num_tracefiles, mm_stats);
         printf("\n");
     }
+    if (csvfile != NULL)
+        writecsv(csvfile, num_tracefiles, tracefiles, mm_stats);
+
+    /* Compare deferred coalescing with the default, immediate coalescing */
+    if (defer) {
+        if (verbose) {
+            printf("Results for mm malloc with deferred coalescing:\n");
+            printresults(num_tracefiles, defer_stats);
+            printf("\n");
+        }
+        printf("Deferred vs. immediate coalescing:\n");
+        printcompareresults(num_tracefiles, mm_stats, defer_stats, "immediate", "deferred");
+        printf("\n");
+        free(defer_stats);
+    }
+
+    /* Show what realloc headroom costs in utilization and saves in copies */
+    if (noroom) {
+        if (verbose) {
+            printf("Results for mm malloc without realloc headroom:\n");
+            printresults(num_tracefiles, noroom_stats);
+            printf("\n");
+        }
+        printf("No realloc headroom vs. headroom:\n");
+        printcompareresults(num_tracefiles, mm_stats, noroom_stats, "headroom", "none");
+        printf("\n");
+        free(noroom_stats);
+    }
+
+    /*
+     * Optionally profile the mm package on every trace it ran correctly:
+     * per-call latency histograms, and hardware events over a replay
+     */
+    if (profile) {
+        if ((mm_prof = (prof_t *)calloc(num_tracefiles, sizeof(prof_t))) == NULL)
+            unix_error("mm_prof calloc in main failed");
+        ncounters = counters_open(&counters);
+        for (i=0; i < num_tracefiles; i++) {
+            if (!mm_stats[i].valid)
+                continue;
+            trace = read_trace(tracedir, tracefiles[i]);
+            if (verbose > 1)
+                printf("Profiling mm_malloc\n");
+            eval_mm_profile(trace, &counters, &mm_prof[i]);
+            free_trace(trace);
+        }
+        counters_close(&counters);
+        printprofresults(num_tracefiles, tracefiles, mm_prof, mm_stats, &counters,
+                         ncounters);
+        printf("\n");
+    }
+
+    /*
+     * Optionally replay every trace on several threads at once, for both
+     * libc and (if it was built thread-safe) the mm package
+     */
+    if (nthreads > 0) {
+        if (mt_mode == MT_PIPE && nthreads % 2 != 0) {
+            fprintf(stderr, "-m pipe needs an even number of threads\n");
+            exit(1);
+        }
+        libc_mt = (mt_stats_t *)calloc(num_tracefiles, sizeof(mt_stats_t));
+        mm_mt = (mt_stats_t *)calloc(num_tracefiles, sizeof(mt_stats_t));
+        if (libc_mt == NULL || mm_mt == NULL)
+            unix_error("mt stats calloc in main failed");
+        if (!MM_THREADS)
+            printf("mm.c was built without MM_THREADS, so -T only replays libc "
+                   "(use \"make mdriver.mt\")\n");
+
+        for (i=0; i < num_tracefiles; i++) {
+            trace = read_trace(tracedir, tracefiles[i]);
+            if (verbose > 1)
+                printf("Replaying on %d threads\n", nthreads);
+            eval_mt_speed(trace, &libc_allocator, mt_mode, nthreads, &libc_mt[i]);
+            if (MM_THREADS && mm_stats[i].valid)
+                eval_mt_speed(trace, &mm_allocator, mt_mode, nthreads, &mm_mt[i]);
+            free_trace(trace);
+        }
+
+        printmtresults(num_tracefiles, tracefiles, mm_mt, libc_mt,
+                       nthreads, mt_mode);
+        printf("\n");
+    }
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -367,30 +695,33 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is an
+ * AVL tree ordered by low address, so that checking, adding, and
+ * removing a block take O(log n) time in the number of live blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
- *     size bytes at addr lo. After checking the block for correctness,
+ *     size bytes at addr lo, aligned to align bytes if align is not 0. 
+ *     After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, int size, int align,
                      int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *q;
     char msg[MAXLINE];
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be ALIGNMENT-byte aligned, or more if asked */
+    if (!IS_ALIGNED_TO(lo, align)) {
         sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
-                lo, ALIGNMENT);
+                lo, align > ALIGNMENT ? align : ALIGNMENT);
         malloc_error(tracenum, opnum, msg);
         return 0;
     }
@@ -404,27 +735,29 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-            sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                    lo, hi, p->lo, p->hi);
-            malloc_error(tracenum, opnum, msg);
-            return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. Since the 
+     * payloads in the tree are disjoint, the only one that can 
+     * overlap [lo, hi] is the one starting closest below hi: any 
+     * other starting at or below hi ends before it starts.
+     */
+    q = find_range(*ranges, hi);
+    if (q != NULL && q->hi >= lo) {
+        sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+                lo, hi, q->lo, q->hi);
+        malloc_error(tracenum, opnum, msg);
+        return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
         unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    *ranges = insert_range(*ranges, p);
     return 1;
 }
 
@@ -432,35 +765,148 @@ static int add_range(range_t **ranges, char *lo, int size,
  * remove_range - Free the range record of block whose payload starts at lo 
  */
 static void remove_range(range_t **ranges, char *lo)
+{
+    *ranges = delete_range(*ranges, lo);
+}
+
+/*
+ * clear_ranges - free all of the range records for a trace 
+ */
+static void clear_ranges(range_t **ranges)
+{
+    range_t *p = *ranges;
+
+    if (p == NULL)
+        return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
+    *ranges = NULL;
+}
+
+/*
+ * find_range - Return the range with the highest low address that is
+ *     at most addr, or NULL if there is none
+ */
+static range_t *find_range(range_t *ranges, char *addr)
+{
+    range_t *best = NULL;
+
+    while (ranges != NULL) {
+        if (ranges->lo <= addr) {
+            best = ranges;
+            ranges = ranges->right;
+        }
+        else
+            ranges = ranges->left;
+    }
+    return best;
+}
+
+/* Height of a (possibly empty) range tree */
+#define RANGE_HEIGHT(p) ((p) == NULL ? 0 : (p)->height)
+
+/*
+ * insert_range - Insert range p into the tree rooted at ranges
+ *     and return the new root
+ */
+static range_t *insert_range(range_t *ranges, range_t *p)
+{
+    if (ranges == NULL) {
+        p->left = p->right = NULL;
+        p->height = 1;
+        return p;
+    }
+    if (p->lo < ranges->lo)
+        ranges->left = insert_range(ranges->left, p);
+    else
+        ranges->right = insert_range(ranges->right, p);
+    return balance_range(ranges);
+}
+
+/*
+ * delete_range - Remove and free the range starting at lo (if any)
+ *     from the tree rooted at ranges, and return the new root
+ */
+static range_t *delete_range(range_t *ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
-    // int size;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            // size = p->hi - p->lo + 1;
+    if (ranges == NULL)
+        return NULL;
+    if (lo < ranges->lo)
+        ranges->left = delete_range(ranges->left, lo);
+    else if (lo > ranges->lo)
+        ranges->right = delete_range(ranges->right, lo);
+    else {
+        p = ranges;
+        if (p->left == NULL || p->right == NULL) {
+            ranges = (p->left != NULL) ? p->left : p->right;
             free(p);
-            break;
+            return ranges;
         }
-        prevpp = &(p->next);
+        /* Replace p by its successor, the lowest range on its right */
+        for (ranges = p->right; ranges->left != NULL; ranges = ranges->left)
+            ;
+        p->lo = ranges->lo;
+        p->hi = ranges->hi;
+        p->right = delete_range(p->right, ranges->lo);
+        ranges = p;
     }
+    return balance_range(ranges);
 }
 
+/* Recompute the height of range p from those of its subtrees */
+#define RANGE_FIX_HEIGHT(p) ((p)->height = 1 + \
+    (RANGE_HEIGHT((p)->left) > RANGE_HEIGHT((p)->right) ? \
+     RANGE_HEIGHT((p)->left) : RANGE_HEIGHT((p)->right)))
+
 /*
- * clear_ranges - free all of the range records for a trace 
+ * rotate_range - Rotate the subtree rooted at p to the right (lifting
+ *     its left child) if right is nonzero, and to the left otherwise,
+ *     and return the new root
  */
-static void clear_ranges(range_t **ranges)
+static range_t *rotate_range(range_t *p, int right)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *q;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    if (right) {
+        q = p->left;
+        p->left = q->right;
+        q->right = p;
     }
-    *ranges = NULL;
+    else {
+        q = p->right;
+        p->right = q->left;
+        q->left = p;
+    }
+    RANGE_FIX_HEIGHT(p);
+    RANGE_FIX_HEIGHT(q);
+    return q;
+}
+
+/*
+ * balance_range - Restore the AVL property at p, whose subtrees are
+ *     balanced and differ in height by at most two, and return the 
+ *     root of the resulting subtree
+ */
+static range_t *balance_range(range_t *p)
+{
+    int diff = RANGE_HEIGHT(p->left) - RANGE_HEIGHT(p->right);
+
+    if (diff > 1) {
+        if (RANGE_HEIGHT(p->left->left) < RANGE_HEIGHT(p->left->right))
+            p->left = rotate_range(p->left, 0);
+        p = rotate_range(p, 1);
+    }
+    else if (diff < -1) {
+        if (RANGE_HEIGHT(p->right->right) < RANGE_HEIGHT(p->right->left))
+            p->right = rotate_range(p->right, 1);
+        p = rotate_range(p, 0);
+    }
+    else
+        RANGE_FIX_HEIGHT(p);
+    return p;
 }
 
 
@@ -470,17 +916,15 @@ static void clear_ranges(range_t **ranges)
 
 /*
  * read_trace - read a trace file and store it in memory
+ *     A binary trace (see tracefmt.h) is mapped and its ops used
+ *     in place; a text trace is parsed into a malloc'd array.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
+    trace_hdr_t hdr;
     char path[MAXLINE];
-    int index, size;
-    int max_index = 0;
-    int op_index;
-    int scan_result = 1;
 
     if (verbose > 1)
         printf("Reading tracefile: %s\n", filename);
@@ -489,22 +933,30 @@ static trace_t *read_trace(char *tracedir, char *filename)
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         unix_error("malloc 1 failed in read_trance");
 	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-        sprintf(msg, "Could not open %s in read_trace", path);
-        unix_error(msg);
-    }
-    scan_result &= fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    scan_result &= fscanf(tracefile, "%d", &(trace->num_ids));     
-    scan_result &= fscanf(tracefile, "%d", &(trace->num_ops));     
-    scan_result &= fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
+    /* Binary traces are used in place, text traces are parsed */
+    if (filename[0] == '/')  /* absolute paths are used as they are */
+        path[0] = '\0';
+    else
+        strcpy(path, tracedir);
+    strncat(path, filename, MAXLINE - strlen(path) - 1);
+    trace->maplen = 0;
+    if (trace_is_bin(path)) {
+        if ((trace->ops = trace_map(path, &hdr, &trace->maplen)) == NULL)
+            exit(1);
+    }
+    else {
+        if ((tracefile = fopen(path, "r")) == NULL) {
+            sprintf(msg, "Could not open %.*s in read_trace", MAXLINE - 32, path);
+            unix_error(msg);
+        }
+        if ((trace->ops = trace_read_rep(tracefile, path, &hdr)) == NULL)
+            exit(1);
+        fclose(tracefile);
+    }
+    trace->sugg_heapsize = hdr.sugg_heapsize; /* not used */
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;               /* not used */
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks = 
@@ -516,52 +968,20 @@ static trace_t *read_trace(char *tracedir, char *filename)
          (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
         unix_error("malloc 4 failed in read_trace");
     
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch(type[0]) {
-        case 'a':
-            scan_result &= fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'r':
-            scan_result &= fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            scan_result &= fscanf(tracefile, "%ud", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-            break;
-        default:
-            printf("Bogus type character (%c) in tracefile %s\n", 
-                   type[0], path);
-            exit(1);
-        }
-        op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
     return trace;
 }
 
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated (or, for the ops of
+ *              a binary trace, mapped) in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->maplen > 0)    /* free the three arrays... */
+        trace_unmap(trace->ops, trace->maplen);
+    else
+        free((void *)trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
@@ -602,10 +1022,21 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
+        case ALLOC: /* mm_malloc or mm_memalign */
+        case CALLOC: /* mm_calloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if (trace->ops[i].type == CALLOC) {
+                if ((p = mm_calloc(1, size)) == NULL) {
+                    malloc_error(tracenum, i, "mm_calloc failed.");
+                    return 0;
+                }
+            } else if (OP_ALIGNED(trace->ops[i])) {
+                if ((p = mm_memalign(trace->ops[i].align, size)) == NULL) {
+                    malloc_error(tracenum, i, "mm_memalign failed.");
+                    return 0;
+                }
+            } else if ((p = mm_malloc(size)) == NULL) {
                 malloc_error(tracenum, i, "mm_malloc failed.");
                 return 0;
             }
@@ -615,8 +1046,18 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
              * to the range list if OK. The block must be  be aligned properly,
              * and must not overlap any currently allocated block. 
              */ 
-            if (add_range(ranges, p, size, tracenum, i) == 0)
+            if (add_range(ranges, p, size, trace->ops[i].align, tracenum, i) == 0)
                 return 0;
+
+            /* A calloc'd block must read as zeros */
+            if (trace->ops[i].type == CALLOC) {
+                for (j = 0; j < size; j++) {
+                    if (p[j] != 0) {
+                        malloc_error(tracenum, i, "mm_calloc did not zero the block");
+                        return 0;
+                    }
+                }
+            }
 	    
             /* ADDED: cgw
              * fill range with low byte of index.  This will be used later
@@ -643,7 +1084,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             remove_range(ranges, oldp);
 	    
             /* Check new block for correctness and add it to range list */
-            if (add_range(ranges, newp, size, tracenum, i) == 0)
+            if (add_range(ranges, newp, size, 0, tracenum, i) == 0)
                 return 0;
 	    
             /* ADDED: cgw
@@ -654,7 +1095,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             oldsize = trace->block_sizes[index];
             if (size < oldsize) oldsize = size;
             for (j = 0; j < oldsize; j++) {
-                if (newp[j] != (index & 0xFF)) {
+                if ((unsigned char)newp[j] != (index & 0xFF)) {
                     malloc_error(tracenum, i, "mm_realloc did not preserve the "
                                  "data from old block");
                     return 0;
@@ -690,13 +1131,14 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   largest size the heap reached while running the student's malloc 
+ *   package on the trace. Since mem_sbrk() lets the package shrink
+ *   the heap again, that peak and the size of the heap at the end
+ *   of the trace are also recorded in stats.
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           stats_t *stats)
 {   
     int i;
     int index;
@@ -705,6 +1147,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    mm_stats_t counters;
+    int snap_every = trace->num_ops / SNAPSHOTS > 0 ? trace->num_ops / SNAPSHOTS : 1;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
@@ -712,13 +1156,20 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+        if (snapping && i > 0 && i % snap_every == 0)
+            snapshot(i, trace->num_ops, total_size);
+
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case CALLOC: /* mm_calloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) 
+            p = trace->ops[i].type == CALLOC ? mm_calloc(1, size) :
+                OP_ALIGNED(trace->ops[i]) ? 
+                mm_memalign(trace->ops[i].align, size) : mm_malloc(size);
+            if (p == NULL) 
                 app_error("mm_malloc failed in eval_mm_util");
 	    
             /* Remember region and size */
@@ -774,10 +1225,56 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
         }
     }
+    if (snapping)
+        snapshot(trace->num_ops, trace->num_ops, total_size);
+
+    stats->peak = mem_peak_heapsize();
+    stats->final = mem_heapsize();
+    mm_stats(&counters);
+    stats->extensions = counters.extensions;
+    stats->reallocs = counters.reallocs;
+    stats->moves = counters.realloc_moves;
+    return ((double)max_total_size / (double)stats->peak);
+}
 
-    return ((double)max_total_size / (double)mem_heapsize());
+
+/*
+ * snap_visit - Called by mm_heap_walk on each block of a snapshot
+ */
+static void snap_visit(void *bp, size_t size, int alloc, void *arg)
+{
+    if (snap_count == 0)
+        snap_first = bp;
+    if (snap_count == snap_max) {
+        snap_max = snap_max ? 2 * snap_max : 4096;
+        if ((snap_blocks = realloc(snap_blocks, snap_max * sizeof(uint32_t))) == NULL)
+            unix_error("realloc failed in snap_visit");
+    }
+    snap_blocks[snap_count++] = SNAP_WORD(size, alloc);
 }
 
+/*
+ * snapshot - Write the layout of the mm heap after op requests of a
+ *     trace of num_ops, with live bytes allocated, to the -S file.
+ *     Block offsets are taken from the payload of the first block,
+ *     which is near enough for a picture of the heap.
+ */
+static void snapshot(int op, int num_ops, size_t live)
+{
+    snap_rec_t rec;
+
+    snap_count = 0;
+    mm_heap_walk(snap_visit, NULL);
+    memset(&rec, 0, sizeof(rec));
+    rec.op = op;
+    rec.num_ops = num_ops;
+    rec.heap_size = mem_heapsize();
+    rec.live_bytes = live;
+    rec.first = snap_count > 0 ? snap_first - (char *)mem_heap_lo() : 0;
+    rec.num_blocks = snap_count;
+    if (snap_write_heap(snapfp, &rec, snap_blocks) < 0)
+        unix_error("Could not write the -S snapshot file");
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -799,9 +1296,13 @@ static void eval_mm_speed(void *ptr)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case CALLOC: /* mm_calloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            p = trace->ops[i].type == CALLOC ? mm_calloc(1, size) :
+                OP_ALIGNED(trace->ops[i]) ? 
+                mm_memalign(trace->ops[i].align, size) : mm_malloc(size);
+            if (p == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -826,6 +1327,97 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm - Check the mm malloc package on a trace and, if it is
+ *     correct, measure its utilization and then its speed using the
+ *     K-best scheme, filling in *stats
+ */
+static void eval_mm(trace_t *trace, int tracenum, range_t **ranges, 
+                    stats_t *stats)
+{
+    speed_t speed_params;
+
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+        printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, ranges);
+    if (stats->valid) {
+        if (verbose > 1)
+            printf("efficiency, ");
+        stats->util = eval_mm_util(trace, tracenum, ranges, stats);
+        speed_params.trace = trace;
+        speed_params.ranges = *ranges;
+        if (verbose > 1)
+            printf("and performance.\n");
+        stats->secs = fsecs(eval_mm_speed, &speed_params);
+        stats->ci = fsecs_ci();
+    }
+}
+
+/*
+ * eval_mm_profile - Profile the mm malloc package on a trace. One
+ *    replay runs with the hardware counters on, and another times
+ *    every call on its own (minus the cost of reading the clock).
+ */
+static void eval_mm_profile(trace_t *trace, counters_t *counters, prof_t *prof)
+{
+    int i, index;
+    unsigned long start, end, overhead;
+    char *p;
+    speed_t speed_params;
+
+    speed_params.trace = trace;
+    counters_start(counters);
+    eval_mm_speed(&speed_params);
+    counters_stop(counters, prof->counters);
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+        app_error("mm_init failed in eval_mm_profile");
+
+    overhead = prof_overhead();
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case CALLOC: /* mm_calloc */
+            start = prof_now();
+            p = trace->ops[i].type == CALLOC ? mm_calloc(1, trace->ops[i].size) :
+                OP_ALIGNED(trace->ops[i]) ? 
+                mm_memalign(trace->ops[i].align, trace->ops[i].size) : 
+                mm_malloc(trace->ops[i].size);
+            end = prof_now();
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_profile");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            start = prof_now();
+            p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            end = prof_now();
+            if (p == NULL)
+                app_error("mm_realloc error in eval_mm_profile");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            start = prof_now();
+            mm_free(trace->blocks[index]);
+            end = prof_now();
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_profile");
+        }
+        end -= start;
+        hist_add(&prof->latency[trace->ops[i].type], 
+                 (end > overhead) ? end - overhead : 0);
+    }
+    prof->valid = 1;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -841,7 +1433,12 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
+        case CALLOC: /* calloc */
+            p = trace->ops[i].type == CALLOC ? calloc(1, trace->ops[i].size) :
+                OP_ALIGNED(trace->ops[i]) ? 
+                aligned_alloc(trace->ops[i].align, trace->ops[i].size) : 
+                malloc(trace->ops[i].size);
+            if (p == NULL) {
                 malloc_error(tracenum, i, "libc malloc failed");
                 unix_error("System message");
             }
@@ -885,9 +1482,13 @@ static void eval_libc_speed(void *ptr)
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
+        case CALLOC: /* calloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = malloc(size)) == NULL)
+            p = trace->ops[i].type == CALLOC ? calloc(1, size) :
+                OP_ALIGNED(trace->ops[i]) ? 
+                aligned_alloc(trace->ops[i].align, size) : malloc(size);
+            if (p == NULL)
                 unix_error("malloc failed in eval_libc_speed");
             trace->blocks[index] = p;
             break;
@@ -911,6 +1512,258 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/******************************************************************
+ * The following routines replay a trace on several threads at once
+ * and measure the aggregate and per-thread throughput.
+ *****************************************************************/
+
+/*
+ * now - current time in seconds, from a clock that never jumps
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * eval_mt_speed - Replay trace on nthreads threads at once with the given
+ *    allocator and report the best of MT_RUNS runs. In MT_COPY mode each
+ *    thread replays the whole trace with its own blocks. In MT_SPLIT mode
+ *    the allocs and reallocs of id go to thread id % nthreads and its free
+ *    to thread (id + 1) % nthreads, which waits until the owner has
+ *    finished with the block. MT_PIPE mode pairs the threads up as
+ *    producer and consumer: the ids are dealt out over the pairs, and
+ *    thread 2k makes every alloc and realloc of the ids of pair k, while
+ *    thread 2k+1 makes all their frees. The mm package is reset before
+ *    each run.
+ */
+static void eval_mt_speed(trace_t *trace, const allocator_t *alloc,
+                          mt_mode_t mode, int nthreads, mt_stats_t *stats)
+{
+    mt_run_t run;
+    mt_thread_t *threads;
+    pthread_t *tids;
+    double start, end, kops;
+    mm_stats_t counters;
+    int i, r;
+
+    run.trace = trace;
+    run.alloc = alloc;
+    run.mode = mode;
+    run.nthreads = nthreads;
+    run.versions = NULL;
+    run.wait_for = NULL;
+    run.failed = 0;
+
+    if ((threads = calloc(nthreads, sizeof(mt_thread_t))) == NULL ||
+        (tids = calloc(nthreads, sizeof(pthread_t))) == NULL)
+        unix_error("calloc failed in eval_mt_speed");
+
+    /* Each thread gets its own block array, except that split and pipe
+     * modes share one */
+    for (i = 0; i < nthreads; i++) {
+        if (mode != MT_COPY && i > 0)
+            threads[i].blocks = threads[0].blocks;
+        else if ((threads[i].blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+            unix_error("calloc failed in eval_mt_speed");
+        threads[i].run = &run;
+        threads[i].tid = i;
+    }
+
+    /* In split and pipe modes, each request on an id waits for the ones
+     * before it: a free for the owner's alloc/reallocs, and, when the id
+     * is used again, the owner's next alloc for the free */
+    if (mode != MT_COPY) {
+        if ((run.versions = calloc(trace->num_ids, sizeof(int))) == NULL ||
+            (run.wait_for = calloc(trace->num_ops, sizeof(int))) == NULL)
+            unix_error("calloc failed in eval_mt_speed");
+        for (i = 0; i < trace->num_ops; i++)
+            run.wait_for[i] = run.versions[trace->ops[i].index]++;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    for (r = 0; r < MT_RUNS; r++) {
+        if (alloc == &mm_allocator) {
+            mem_reset_brk();
+            if (mm_init() < 0)
+                app_error("mm_init failed in eval_mt_speed");
+        }
+        if (mode != MT_COPY)
+            memset(run.versions, 0, trace->num_ids * sizeof(int));
+        pthread_barrier_init(&run.barrier, NULL, nthreads);
+
+        for (i = 0; i < nthreads; i++)
+            if ((errno = pthread_create(&tids[i], NULL, mt_thread, &threads[i])) != 0)
+                unix_error("pthread_create failed in eval_mt_speed");
+        for (i = 0; i < nthreads; i++)
+            pthread_join(tids[i], NULL);
+        pthread_barrier_destroy(&run.barrier);
+        if (run.failed)
+            break;
+
+        /* Keep the run with the shortest wall time */
+        start = threads[0].start;
+        end = threads[0].end;
+        for (i = 1; i < nthreads; i++) {
+            start = (threads[i].start < start) ? threads[i].start : start;
+            end = (threads[i].end > end) ? threads[i].end : end;
+        }
+        if (r > 0 && end - start >= stats->secs)
+            continue;
+
+        stats->valid = 1;
+        stats->secs = end - start;
+        if (alloc == &mm_allocator) {
+            mm_stats(&counters);
+            stats->remote = counters.remote_frees;
+        }
+        stats->ops = 0;
+        stats->min_kops = DBL_MAX;
+        stats->avg_kops = 0;
+        stats->max_kops = 0;
+        for (i = 0; i < nthreads; i++) {
+            kops = (threads[i].ops/1e3)/(threads[i].end - threads[i].start);
+            stats->ops += threads[i].ops;
+            stats->avg_kops += kops/nthreads;
+            stats->min_kops = (kops < stats->min_kops) ? kops : stats->min_kops;
+            stats->max_kops = (kops > stats->max_kops) ? kops : stats->max_kops;
+        }
+    }
+
+    if (run.failed) {
+        stats->valid = 0;
+        printf("%s failed during the %d-thread replay\n",
+               (alloc == &mm_allocator) ? "mm" : "libc", nthreads);
+    }
+
+    for (i = 0; i < nthreads; i++)
+        if (mode == MT_COPY || i == 0)
+            free(threads[i].blocks);
+    free(run.versions);
+    free(run.wait_for);
+    free(threads);
+    free(tids);
+}
+
+/*
+ * mt_thread - Body of one replay thread (see eval_mt_speed)
+ */
+static void *mt_thread(void *ptr)
+{
+    mt_thread_t *self = (mt_thread_t *)ptr;
+    mt_run_t *run = self->run;
+    trace_t *trace = run->trace;
+    const allocator_t *alloc = run->alloc;
+    int shared = (run->mode != MT_COPY);
+    int i, index, owner;
+    cpu_set_t cpus;
+    char *p;
+
+    /* With -N local, a thread stays on one CPU, so the node it grows
+     * the heap on is the one it keeps running on */
+    if (pin_threads) {
+        CPU_ZERO(&cpus);
+        CPU_SET(self->tid % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    self->ops = 0;
+    pthread_barrier_wait(&run->barrier);
+    self->start = now();
+
+    for (i = 0;  i < trace->num_ops && !__atomic_load_n(&run->failed, __ATOMIC_RELAXED);  i++) {
+        index = trace->ops[i].index;
+        if (shared) {
+            /* the owner of an id allocates it, the next thread frees it */
+            if (run->mode == MT_SPLIT)
+                owner = (index + (trace->ops[i].type == FREE)) % run->nthreads;
+            else
+                owner = 2 * (index % (run->nthreads / 2)) + (trace->ops[i].type == FREE);
+            if (owner != self->tid)
+                continue;
+            while (__atomic_load_n(&run->versions[index], __ATOMIC_ACQUIRE)
+                   < run->wait_for[i] && !__atomic_load_n(&run->failed, __ATOMIC_RELAXED))
+                sched_yield(); /* wait until the block is published */
+            if (__atomic_load_n(&run->failed, __ATOMIC_RELAXED))
+                break;
+        }
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+        case CALLOC: /* calloc */
+            p = trace->ops[i].type == CALLOC ? alloc->calloc(1, trace->ops[i].size) :
+                OP_ALIGNED(trace->ops[i]) ? 
+                alloc->memalign(trace->ops[i].align, trace->ops[i].size) : 
+                alloc->malloc(trace->ops[i].size);
+            if (p == NULL) {
+                __atomic_store_n(&run->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            self->blocks[index] = p;
+            break;
+
+        case REALLOC: /* realloc */
+            if ((p = alloc->realloc(self->blocks[index], trace->ops[i].size)) == NULL) {
+                __atomic_store_n(&run->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+            self->blocks[index] = p;
+            break;
+
+        case FREE: /* free */
+            alloc->free(self->blocks[index]);
+            break;
+
+        default:
+            app_error("Nonexistent request type in mt_thread");
+        }
+        self->ops++;
+
+        /* Publish the block (or its free) to the thread with the next request */
+        if (shared)
+            __atomic_fetch_add(&run->versions[index], 1, __ATOMIC_RELEASE);
+    }
+
+    self->end = now();
+    return NULL;
+}
+
+/*
+ * printmtresults - prints the multi-threaded replay results for mm and
+ *    libc side by side
+ */
+static void printmtresults(int n, char **tracefiles, mt_stats_t *mm_mt,
+                           mt_stats_t *libc_mt, int nthreads, mt_mode_t mode)
+{
+    int i;
+
+    printf("\nResults for %d threads (%s mode), Kops/sec aggregate and per "
+           "thread min/avg/max, and mm frees\nleft for the lock holder:\n",
+           nthreads, mt_mode_names[mode]);
+    printf("%5s %-20s %9s %20s %9s %20s %8s\n",
+           "trace", "name", "mm", "mm per thread", "libc", "libc per thread", "remote");
+    for (i=0; i < n; i++) {
+        printf("%2d    %-20.20s ", i, tracefiles[i]);
+        if (mm_mt[i].valid)
+            printf("%9.0f %6.0f/%6.0f/%6.0f ", (mm_mt[i].ops/1e3)/mm_mt[i].secs,
+                   mm_mt[i].min_kops, mm_mt[i].avg_kops, mm_mt[i].max_kops);
+        else
+            printf("%9s %20s ", "-", "-");
+        if (libc_mt[i].valid)
+            printf("%9.0f %6.0f/%6.0f/%6.0f ", (libc_mt[i].ops/1e3)/libc_mt[i].secs,
+                   libc_mt[i].min_kops, libc_mt[i].avg_kops, libc_mt[i].max_kops);
+        else
+            printf("%9s %20s ", "-", "-");
+        if (mm_mt[i].valid)
+            printf("%8lu\n", mm_mt[i].remote);
+        else
+            printf("%8s\n", "-");
+    }
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -925,25 +1778,37 @@ static void printresults(int n, stats_t *stats)
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double var = 0;  /* of the total time, summed over the traces */
 
-    /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-           "trace", " valid", "util", "ops", "secs", "Kops");
+    /* Print the individual results for each trace; ci is the half-width
+     * of the 95% confidence interval of secs, in percent */
+    printf("%5s%7s %5s%9s%10s%6s%6s%8s%8s%6s\n", 
+           "trace", " valid", "util", "ops", "secs", "Kops", "ci", "peakKB", "finalKB", "ext");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
-            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f\n", 
+            printf("%2d%10s%5.0f%%%9.0f%10.6f%8.0f", 
                    i,
                    "yes",
                    stats[i].util*100.0,
                    stats[i].ops,
                    stats[i].secs,
                    (stats[i].ops/1e3)/stats[i].secs);
+            if (stats[i].ci > 0)
+                printf("%5.1f%%", 100.0 * stats[i].ci / stats[i].secs);
+            else
+                printf("%6s", "-");
+            if (stats[i].peak > 0)
+                printf("%8zu%8zu%6lu\n", stats[i].peak / 1024, stats[i].final / 1024,
+                       stats[i].extensions);
+            else
+                printf("%8s%8s%6s\n", "-", "-", "-");
             secs += stats[i].secs;
             ops += stats[i].ops;
             util += stats[i].util;
+            var += stats[i].ci * stats[i].ci;
         }
         else {
-            printf("%2d%10s%6s%8s%10s%8s\n", 
+            printf("%2d%10s%6s%9s%10s%8s\n", 
                    i,
                    "no",
                    "-",
@@ -955,15 +1820,19 @@ static void printresults(int n, stats_t *stats)
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-        printf("%12s%5.0f%%%8.0f%10.6f%8.0f\n", 
+        printf("%12s%5.0f%%%9.0f%10.6f%8.0f", 
                "Total       ",
                (util/n)*100.0,
                ops, 
                secs,
                (ops/1e3)/secs);
+        if (var > 0)
+            printf("%5.1f%%\n", 100.0 * sqrt(var) / secs);
+        else
+            printf("\n");
     }
     else {
-        printf("%12s%6s%8s%10s%8s\n", 
+        printf("%12s%6s%9s%10s%8s\n", 
                "Total       ",
                "-", 
                "-", 
@@ -973,6 +1842,126 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * writecsv - writes the results of some malloc package to filename, one
+ *     line per trace, for scripts (such as "make bench") to compare
+ */
+static void writecsv(char *filename, int n, char **tracefiles, stats_t *stats)
+{
+    FILE *fp;
+    int i;
+
+    if ((fp = fopen(filename, "w")) == NULL)
+        unix_error("Could not open the CSV file in writecsv");
+    fprintf(fp, "trace,valid,ops,util,secs,kops,peak,final,ext,ci\n");
+    for (i=0; i < n; i++) {
+        if (stats[i].valid)
+            fprintf(fp, "%s,1,%.0f,%.2f,%.6f,%.0f,%zu,%zu,%lu,%.2f\n",
+                    tracefiles[i],
+                    stats[i].ops,
+                    stats[i].util*100.0,
+                    stats[i].secs,
+                    (stats[i].ops/1e3)/stats[i].secs,
+                    stats[i].peak,
+                    stats[i].final,
+                    stats[i].extensions,
+                    100.0 * stats[i].ci / stats[i].secs);
+        else
+            fprintf(fp, "%s,0,%.0f,,,,,,,\n", tracefiles[i], stats[i].ops);
+    }
+    if (fclose(fp) != 0)
+        unix_error("Could not write the CSV file in writecsv");
+}
+
+/*
+ * printcompareresults - prints the utilization, throughput and realloc
+ *    copies of each trace with two configurations of mm side by side
+ */
+static void printcompareresults(int n, stats_t *base, stats_t *other,
+                                char *base_name, char *other_name)
+{
+    int i;
+    double ops = 0, secs = 0, other_secs = 0, util = 0, other_util = 0;
+    unsigned long moves = 0, other_moves = 0;
+
+    printf("%5s%22s%22s%9s\n", "trace", base_name, other_name, "speedup");
+    printf("%5s%6s%10s%6s%6s%10s%6s\n", "", "util", "Kops", "moved", "util", "Kops", "moved");
+    for (i=0; i < n; i++) {
+        if (!base[i].valid || !other[i].valid) {
+            printf("%2d%9s\n", i, "invalid");
+            continue;
+        }
+        printf("%2d%8.0f%%%10.0f%6lu%5.0f%%%10.0f%6lu%8.2fx\n", i,
+               base[i].util*100.0, base[i].ops/1e3/base[i].secs, base[i].moves,
+               other[i].util*100.0, other[i].ops/1e3/other[i].secs, other[i].moves,
+               base[i].secs/other[i].secs);
+        ops += base[i].ops;
+        secs += base[i].secs;
+        other_secs += other[i].secs;
+        util += base[i].util;
+        other_util += other[i].util;
+        moves += base[i].moves;
+        other_moves += other[i].moves;
+    }
+    if (secs > 0 && other_secs > 0)
+        printf("%-5s%5.0f%%%10.0f%6lu%5.0f%%%10.0f%6lu%8.2fx\n", "Total",
+               util/n*100.0, ops/1e3/secs, moves, other_util/n*100.0, ops/1e3/other_secs,
+               other_moves, secs/other_secs);
+}
+
+/*
+ * printprofresults - prints the latency percentiles of each call type
+ *    and the hardware events per op of every profiled trace
+ */
+static void printprofresults(int n, char **tracefiles, prof_t *prof,
+                             stats_t *stats, const counters_t *counters,
+                             int ncounters)
+{
+    static const char *names[4] = {"malloc", "free", "realloc", "calloc"};
+    int i, j, type;
+
+    printf("\nLatency profile for mm malloc (ns per call):\n");
+    printf("%5s %-20s %-8s%9s%8s%8s%8s%9s\n",
+           "trace", "name", "call", "count", "p50", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+        if (!prof[i].valid)
+            continue;
+        for (type = ALLOC; type <= CALLOC; type++) {
+            hist_t *hist = &prof[i].latency[type];
+
+            if (hist->count == 0)
+                continue;
+            printf("%2d    %-20.20s %-8s%9lu%8lu%8lu%8lu%9lu\n", i, tracefiles[i], 
+                   names[type], hist->count, hist_percentile(hist, 50), 
+                   hist_percentile(hist, 99), hist_percentile(hist, 99.9), 
+                   hist->max);
+        }
+    }
+
+    if (ncounters == 0) {
+        printf("\nHardware counters are not available (perf_event_open: %s)\n",
+               strerror(counters->error));
+        return;
+    }
+    printf("\nHardware events for mm malloc (per op):\n");
+    printf("%5s %-20s", "trace", "name");
+    for (j = 0; j < NUM_COUNTERS; j++)
+        printf("%14s", counter_names[j]);
+    printf("\n");
+    for (i=0; i < n; i++) {
+        if (!prof[i].valid)
+            continue;
+        printf("%2d    %-20.20s", i, tracefiles[i]);
+        for (j = 0; j < NUM_COUNTERS; j++) {
+            if (prof[i].counters[j] < 0)
+                printf("%14s", "-");
+            else
+                printf("%14.2f", prof[i].counters[j] / stats[i].ops);
+        }
+        printf("\n");
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1005,14 +1994,25 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValPDRF] [-f <file>]... [-t <dir>] [-o <csv>] [-H <pages>] [-N <numa>] [-C <cpu>] [-S <snaps>] [-T <n> [-m copy|split|pipe]]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-C <cpu>   Run the driver on CPU <cpu> only while it times.\n");
+    fprintf(stderr, "\t-D         Also evaluate mm with deferred coalescing, and compare.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as a trace file (may be repeated).\n");
+    fprintf(stderr, "\t-F         Start every run of mm on fresh (zeroed, unmapped) pages.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <pages> Back the heap with none (ordinary pages), thp or hugetlb huge pages.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-P         Profile mm: latency percentiles and hardware counters.\n");
+    fprintf(stderr, "\t-R         Also evaluate mm without realloc headroom, and compare.\n");
+    fprintf(stderr, "\t-N <numa>  Put heap pages where first touched (first), on the growing thread's node (local), or interleave them.\n");
+    fprintf(stderr, "\t-o <csv>   Also write the per-trace mm results to <csv>.\n");
+    fprintf(stderr, "\t-S <snaps> Write snapshots of the mm heap over each trace to <snaps>.\n");
+    fprintf(stderr, "\t-m <mode>  -T mode: copy (whole trace per thread), split (ids dealt out, cross-thread frees) or pipe (one thread allocs, its partner frees).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on <n> threads at once.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
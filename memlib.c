@@ -2,6 +2,28 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * With USE_MMAP_HEAP (see config.h), the heap is a range of MAX_HEAP bytes
+ * of address space reserved with mmap(PROT_NONE). Pages are made
+ * accessible MEM_COMMIT bytes at a time as mem_sbrk moves the brk past
+ * them, so only memory the heap has reached is ever touched. When mem_sbrk
+ * shrinks the heap, the pages it gives up are returned to the kernel
+ * with madvise(MADV_DONTNEED).
+ *
+ * memlib also keeps track of where the heap area that has never been used
+ * begins: past the highest brk reached since those pages were mapped or
+ * given back, memory reads as zeros (see mem_fresh_lo).
+ *
+ * Before mem_init, mem_use_hugepages can ask for the heap to be backed by
+ * MEM_HUGE_PAGE (2 MB) pages, so that large heaps take fewer TLB misses:
+ * either transparent huge pages, advised with madvise(MADV_HUGEPAGE), or
+ * pages of the hugetlbfs pool, mapped with MAP_HUGETLB over each range as
+ * it is committed (falling back to ordinary pages when the pool runs
+ * out). Either way the reserved range is aligned to MEM_HUGE_PAGE and
+ * committed that much at a time. mem_set_numa likewise sets where the
+ * committed pages go: wherever they are first touched (the kernel's
+ * default), on the node of the thread whose mem_sbrk committed them, or
+ * interleaved over all nodes.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +32,7 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/syscall.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -18,6 +41,28 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_peak;      /* largest heap size since the last reset */
+static char *mem_fresh;      /* no heap byte from here on has been used */
+static int mem_release_resets; /* does mem_reset_brk give the heap's pages back? */
+static int mem_pages = MEM_PAGES_SMALL;       /* set by mem_use_hugepages */
+static int mem_numa = MEM_NUMA_FIRST_TOUCH;   /* set by mem_set_numa */
+#if USE_MMAP_HEAP
+static char *mem_commit_brk; /* end of the accessible part of the heap */
+static size_t mem_commit;    /* granularity of committing and releasing pages */
+
+/* Granularity of committing reserved pages (a multiple of the page size) */
+#define MEM_COMMIT (1<<16)
+
+/* Memory policies of mbind(2), if <numaif.h> is not at hand */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED  1
+#define MPOL_INTERLEAVE 3
+#endif
+
+static int mem_commit_range(char *lo, size_t len);
+static void mem_bind(char *lo, size_t len);
+static void mem_release(char *lo, char *hi);
+#endif
 
 /* 
  * mem_init - initialize the memory system model
@@ -25,13 +70,36 @@ static char *mem_max_addr;   /* largest legal heap address */
 void mem_init(void)
 {
     /* allocate the storage we will use to model the available VM */
+#if USE_MMAP_HEAP
+    char *map, *end;
+
+    /* With huge pages, reserve a MEM_HUGE_PAGE more, to align the heap */
+    mem_commit = (mem_pages == MEM_PAGES_SMALL) ? MEM_COMMIT : MEM_HUGE_PAGE;
+    map = mmap(NULL, MAX_HEAP + mem_commit, PROT_NONE, 
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+	   fprintf(stderr, "mem_init_vm: mmap error\n");
+	   exit(1);
+    }
+    mem_start_brk = (char *)(((size_t)map + mem_commit - 1) / mem_commit * mem_commit);
+    end = mem_start_brk + MAX_HEAP;
+    if (mem_start_brk > map)
+        munmap(map, mem_start_brk - map);
+    if (map + MAX_HEAP + mem_commit > end)
+        munmap(end, map + MAX_HEAP + mem_commit - end);
+    mem_commit_brk = mem_start_brk;
+    mem_fresh = mem_start_brk;
+#else
     if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
 	   fprintf(stderr, "mem_init_vm: malloc error\n");
 	   exit(1);
     }
+    mem_fresh = mem_start_brk + MAX_HEAP; /* malloc'd memory is never known to be zero */
+#endif
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak = 0;
 }
 
 /* 
@@ -39,35 +107,216 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
+#if USE_MMAP_HEAP
+    munmap(mem_start_brk, MAX_HEAP);
+#else
     free(mem_start_brk);
+#endif
 }
 
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ *    Pages that are already committed stay so, for the next run. Their
+ *    contents stay too, unless mem_release_on_reset asked for them to be
+ *    given back to the kernel, in which case the next run starts on
+ *    fresh memory.
  */
 void mem_reset_brk()
 {
+#if USE_MMAP_HEAP
+    if (mem_release_resets && mem_fresh > mem_start_brk) {
+        madvise(mem_start_brk, (mem_fresh - mem_start_brk + mem_commit - 1) / mem_commit * mem_commit,
+                MADV_DONTNEED);
+        mem_fresh = mem_start_brk;
+    }
+#endif
     mem_brk = mem_start_brk;
+    mem_peak = 0;
+}
+
+/*
+ * mem_use_hugepages - choose, before mem_init, what pages back the heap:
+ *    MEM_PAGES_SMALL (the default), MEM_PAGES_THP or MEM_PAGES_HUGETLB.
+ *    Without USE_MMAP_HEAP, the heap always gets what malloc gives it.
+ */
+void mem_use_hugepages(int pages)
+{
+    mem_pages = pages;
+}
+
+/*
+ * mem_set_numa - choose the NUMA node the pages of the heap are put on:
+ *    MEM_NUMA_FIRST_TOUCH (the default) leaves it to the kernel, which
+ *    uses the node of the thread that first touches a page;
+ *    MEM_NUMA_LOCAL prefers the node of the thread that commits it (that
+ *    grows the heap over it), and MEM_NUMA_INTERLEAVE spreads pages over
+ *    all nodes. Only effective with USE_MMAP_HEAP.
+ */
+void mem_set_numa(int policy)
+{
+    mem_numa = policy;
+}
+
+/*
+ * mem_release_on_reset - choose whether mem_reset_brk gives the pages
+ *    of the heap back to the kernel (release != 0) or keeps them as they
+ *    are (the default). Without USE_MMAP_HEAP, pages are always kept.
+ */
+void mem_release_on_reset(int release)
+{
+    mem_release_resets = release;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A 
+ *    negative incr shrinks the heap by -incr bytes instead, and returns
+ *    the old end of the heap.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr < 0) {
+        if (-incr > mem_brk - mem_start_brk) {
+            errno = EINVAL;
+            fprintf(stderr, "ERROR: mem_sbrk failed. Heap cannot shrink below its start...\n");
+            return (void *)-1;
+        }
+        mem_brk += incr;
+#if USE_MMAP_HEAP
+        mem_release(mem_brk, old_brk);
+#endif
+        return (void *)old_brk;
+    }
+
+    if ((mem_brk + incr) > mem_max_addr) {
 	   errno = ENOMEM;
 	   fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	   return (void *)-1;
     }
+#if USE_MMAP_HEAP
+    if (mem_brk + incr > mem_commit_brk) {
+        /* commit up to the next mem_commit boundary past the new brk */
+        size_t len = (mem_brk + incr - mem_commit_brk + mem_commit - 1) 
+            / mem_commit * mem_commit;
+
+        if (len > (size_t)(mem_max_addr - mem_commit_brk))
+            len = mem_max_addr - mem_commit_brk;
+        if (mem_commit_range(mem_commit_brk, len) < 0) {
+            fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+            return (void *)-1;
+        }
+        mem_commit_brk += len;
+    }
+#endif
     mem_brk += incr;
+    if (mem_brk > mem_fresh)
+        mem_fresh = mem_brk;
+    if ((size_t)(mem_brk - mem_start_brk) > mem_peak)
+        mem_peak = mem_brk - mem_start_brk;
     return (void *)old_brk;
 }
 
+#if USE_MMAP_HEAP
+/*
+ * mem_commit_range - make the reserved pages in [lo, lo+len) accessible,
+ *    with the pages and NUMA policy asked for. lo and len are multiples
+ *    of mem_commit. Returns 0, or -1 if the pages could not be committed.
+ */
+static int mem_commit_range(char *lo, size_t len)
+{
+    static int warned;
+
+    if (mem_pages == MEM_PAGES_HUGETLB) {
+        /* replace the reservation with hugetlbfs pages, reserved now so
+         * that running out shows here rather than as a SIGBUS later */
+        if (mmap(lo, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED) {
+            mem_bind(lo, len);
+            return 0;
+        }
+        if (!warned) {
+            warned = 1;
+            fprintf(stderr, "Warning: no huge pages left in the hugetlbfs pool "
+                    "(see /proc/sys/vm/nr_hugepages), using ordinary pages\n");
+        }
+        /* the failed mmap may have taken the reservation with it */
+        if (mmap(lo, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) == MAP_FAILED)
+            return -1;
+    } else if (mprotect(lo, len, PROT_READ | PROT_WRITE) < 0)
+        return -1;
+    if (mem_pages != MEM_PAGES_SMALL)
+        madvise(lo, len, MADV_HUGEPAGE);
+    mem_bind(lo, len);
+    return 0;
+}
+
+/*
+ * mem_bind - apply the NUMA policy to the pages in [lo, lo+len), which
+ *    have not been touched yet
+ */
+static void mem_bind(char *lo, size_t len)
+{
+    static unsigned long all_nodes;
+    unsigned long mask;
+    unsigned cpu, node;
+    FILE *fp;
+    int a, b;
+    char sep;
+
+    switch (mem_numa) {
+    case MEM_NUMA_LOCAL:
+        if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0 || node >= 8 * sizeof(mask))
+            return;
+        mask = 1UL << node;
+        syscall(SYS_mbind, lo, len, MPOL_PREFERRED, &mask, 8 * sizeof(mask) + 1, 0);
+        break;
+
+    case MEM_NUMA_INTERLEAVE:
+        /* the online nodes, listed as ranges like "0-1,3" */
+        if (all_nodes == 0 && (fp = fopen("/sys/devices/system/node/online", "r")) != NULL) {
+            while (fscanf(fp, "%d", &a) == 1) {
+                b = a;
+                if ((sep = fgetc(fp)) == '-' && fscanf(fp, "%d", &b) == 1)
+                    sep = fgetc(fp);
+                for (; a <= b && a < (int)(8 * sizeof(mask)); a++)
+                    all_nodes |= 1UL << a;
+                if (sep != ',')
+                    break;
+            }
+            fclose(fp);
+        }
+        if (all_nodes != 0)
+            syscall(SYS_mbind, lo, len, MPOL_INTERLEAVE, &all_nodes, 8 * sizeof(mask) + 1, 0);
+        break;
+    }
+}
+
+/*
+ * mem_release - give the whole pages in [lo, hi) back to the kernel. They
+ *    stay committed, and read as zeros when the heap grows over them again,
+ *    so if nothing above them has been used, the fresh area now starts
+ *    with them. With huge pages, only whole MEM_HUGE_PAGEs are given back;
+ *    the fresh area then stays where it was unless they reach up to hi,
+ *    since the bytes between the last of them and hi keep what was written.
+ */
+static void mem_release(char *lo, char *hi)
+{
+    size_t pagesize = (mem_pages == MEM_PAGES_SMALL) ? mem_pagesize() : MEM_HUGE_PAGE;
+    char *start = mem_start_brk + 
+        (lo - mem_start_brk + pagesize - 1) / pagesize * pagesize;
+    char *end = mem_start_brk + (hi - mem_start_brk) / pagesize * pagesize;
+
+    if (mem_pages == MEM_PAGES_SMALL)
+        end = hi;
+    if (start < end && madvise(start, end - start, MADV_DONTNEED) == 0 &&
+        end == hi && mem_fresh == hi)
+        mem_fresh = start;
+}
+#endif
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +333,17 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_fresh_lo - return the address from which the heap area has not been
+ *    used since it was mapped or last given back to the kernel. The bytes
+ *    from there to the end of the area all read as zeros. It is never below
+ *    the brk.
+ */
+void *mem_fresh_lo()
+{
+    return (void *)mem_fresh;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
@@ -92,6 +352,15 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the heap was last reset
+ */
+size_t mem_peak_heapsize() 
+{
+    return mem_peak;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
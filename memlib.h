@@ -1,11 +1,27 @@
 #include <unistd.h>
 
+/* What pages back the heap (mem_use_hugepages) */
+#define MEM_PAGES_SMALL    0  /* ordinary pages */
+#define MEM_PAGES_THP      1  /* transparent huge pages, by madvise */
+#define MEM_PAGES_HUGETLB  2  /* the hugetlbfs pool, by MAP_HUGETLB */
+#define MEM_HUGE_PAGE      (1<<21)
+
+/* Where the pages of the heap go (mem_set_numa) */
+#define MEM_NUMA_FIRST_TOUCH  0  /* the node of the thread that first touches them */
+#define MEM_NUMA_LOCAL        1  /* the node of the thread that commits them */
+#define MEM_NUMA_INTERLEAVE   2  /* spread over all nodes */
+
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
+void mem_release_on_reset(int release);
+void mem_use_hugepages(int pages);
+void mem_set_numa(int policy);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_fresh_lo(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
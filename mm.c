@@ -1,47 +1,171 @@
 /* 
- * Simple allocator based on explicit free lists, first fit search,
- * and boundary tag coalescing. 
+ * Simple allocator based on segregated explicit free lists, first fit
+ * search within each size class, and boundary tag coalescing. 
  *
- * Each block has header and footer of the form:
+ * Each block has a header, and each free block also has a footer, of the form:
  * 
- *      64                  4  3  2  1  0 
- *      -----------------------------------
- *     | s  s  s  s  ... s  s  0  0  0  a/f
- *      ----------------------------------- 
+ *      64                  4  3  2   1   0 
+ *      ---------------------------------------
+ *     | s  s  s  s  ... s  s  r  r  pa/pf a/f
+ *      --------------------------------------- 
  * 
- * where s are the meaningful size bits and a/f is 1 
- * if and only if the block is allocated. The heap has the following form:
+ * where s are the meaningful size bits, a/f is 1 if and only if the block
+ * is allocated, and pa/pf is 1 if and only if the previous block in memory
+ * is allocated. Since coalescing only needs the previous block's footer
+ * when that block is free, allocated blocks do without one. The pa/pf bit
+ * is only meaningful in headers. In the header of an allocated block, the
+ * r bits count how many times mm_realloc has resized it (up to 3); they
+ * are 0 in free blocks. (With MM_THREADS, a block reused from a thread
+ * cache keeps the count of its last use, as the cache takes no lock to
+ * clear it.) The heap has the following form:
  *
- * begin                                                             end
- * heap                                                             heap  
- *  ---------------------------------------------------------------------  
- * |  HEAD   | hdr(16:a) | ftr(16:a) | zero or more usr blks | hdr(0:a) |
- *  --------------------------------------------------------------------
- *          |       prologue        |                       | epilogue |
- *          |         block         |                       | block    |
+ * begin                                                                  end
+ * heap                                                                  heap  
+ *  --------------------------------------------------------------------------  
+ * | list heads | hdr(16:a) | ftr(16:a) | zero or more usr blks | hdr(0:a) |
+ *  --------------------------------------------------------------------------
+ *              |       prologue        |                       | epilogue |
+ *              |         block         |                       | block    |
  *
  * The allocated prologue and epilogue blocks are overhead that
  * eliminate edge conditions during coalescing.
  * 
- * The explicit free list is structured such that the head of the free list 
- * is stored before the prologue block. It stores a pointer to the first
- * free block.
+ * Free blocks of up to SMALL_LIMIT bytes are kept on NUM_SMALL explicit
+ * free lists, one exact class for each multiple of 16 bytes, so small
+ * requests never walk past blocks that are slightly too small. Larger free
+ * blocks form one more class, kept in order of size and then address in a
+ * side index outside the heap (see below). The heads of the lists are
+ * stored before the prologue block, in the area that is padded to an odd
+ * number of words so that the first payload stays double-word aligned.
  * 
- * Each allocated block contains a header, a footer, and at least two words of
- * payload for the user.
+ * Each allocated block contains a header and at least three words of payload
+ * for the user, so that it is large enough to hold a free block once freed.
  * 
  * Each free block contains a header, footer, a pointer to the next free block
  * in list order, and a pointer to the previous free block in list order. The 
  * pointer to the next free block is stored immediately after the header, and
  * the pointer to the previous free block immediately thereafter. When adding
- * a block to the list, we make the head point to it after updating its next
- * field to match the previous head value. The final free block, or the head if
- * the list is empty, has NULL as the value for its pointer to the next block.
+ * a block to its class list, we make the head point to it after updating its
+ * next field to match the previous head value. The final free block of a list
+ * has NULL as the value for its pointer to the next block, and the first has
+ * NULL as the value for its pointer to the previous block.
+ *
+ * The large-block index is a pair of sorted arrays, one of the sizes of
+ * the large free blocks and one of their addresses, so that a fit search
+ * is a binary search and then a short linear scan over contiguous sizes,
+ * and the heap is only touched at the block it returns, instead of a walk
+ * of dependent pointers through blocks all over the heap. Inserting or
+ * removing a block moves the entries after it; with at most a few hundred
+ * large free blocks on most traces, that costs less than the cache misses
+ * it saves. The arrays hold INDEX_SMALL blocks: once there would be more,
+ * the large blocks move to an AVL tree, each free block storing the
+ * pointers to its left and right children in those two words, followed by
+ * the height of its subtree, and once their number falls to a quarter of
+ * that, they move back. With MM_INDEX_TREE (see config.h), they are always
+ * in the tree.
  * 
- * The allocator goes to the block pointed to by HEAD, and proceeds along the 
- * list, checking each block for size, then if that block isn't large enough, 
- * going to the next block. When it comes to NULL, it returns NULL to malloc, 
- * causing malloc to request more space.
+ * The allocator starts at the list for the size class of the request and
+ * takes its first block. If that list is empty, it moves on to the next
+ * larger class, where any block will fit. Once the small classes are
+ * exhausted, it takes the best fit from the index: the smallest large block
+ * that fits, the lowest one in memory among equals. When that fails too,
+ * it returns NULL to malloc, causing malloc to request more space.
+ * Conversely, when a free leaves a free block of trim_threshold bytes or
+ * more at the end of the heap, all but TRIM_KEEP bytes of it are handed
+ * back with a negative mem_sbrk. Trimming waits until TRIM_DELAY blocks
+ * have been freed since the heap last grew, so that a heap is not given
+ * back (and faulted in again) as soon as a burst of demand ends, but only
+ * once demand has stayed low for a while. The threshold starts at
+ * TRIM_THRESHOLD, and whenever the heap has to grow again after a trim, it
+ * is raised to twice what that trim gave back, so that a heap whose demand
+ * comes in slow waves is trimmed once rather than on every wave.
+ *
+ * When built with MM_THREADS (see config.h), the heap above is shared by all
+ * threads and protected by a single lock. In front of it, each thread keeps
+ * a small cache of allocated-but-unused blocks for every block size up to
+ * TCACHE_MAX. mm_malloc and mm_free serve requests from that cache without
+ * locking; only when a bin runs empty (or overflows) does the thread take the
+ * lock and move TCACHE_BATCH blocks between its cache and the shared heap.
+ * A free that finds the lock held does not wait for it: the block (or the
+ * batch leaving a full bin) is pushed on remote_frees, a lock-free stack
+ * linked through the blocks' first payload words, with one compare-and-
+ * swap. The next thread to allocate under the lock takes the whole stack
+ * with one exchange and frees its blocks before it searches for a fit, so
+ * a thread that only frees blocks others allocated never waits on them.
+ * Cached blocks stay marked allocated, so they are never coalesced while
+ * they sit in a cache.
+ *
+ * Requests of up to SLAB_MAX bytes skip the block heap altogether. Each of
+ * the SLAB_CLASSES slot sizes (16, 32, 48 and 64 bytes) has its own slab
+ * pages: SLAB_PAGE-aligned pages, each a single allocated block carved from
+ * a free block that can hold it or else placed at the end of the heap, whose
+ * first SLAB_HDR bytes hold a slab_t and the rest
+ * equal slots without headers. A bitmap in the slab_t records which slots
+ * are in use, so allocating or freeing a slot is a bit operation. Pages with
+ * free slots are kept on a doubly linked list per class; a page that
+ * becomes empty is returned to the block heap, unless it is the last page
+ * on its list. A bitmap with one bit per SLAB_PAGE of the heap (slab_map)
+ * tells mm_free and mm_realloc whether a pointer is a slot. To keep traces
+ * with only a few small requests from paying for whole pages, the first
+ * SLAB_WARMUP requests of each class are still served by ordinary blocks.
+ *
+ * When built with MM_CHECK (see config.h), every call that changes the
+ * heap checks the blocks it touched: the block itself, its neighbors in
+ * memory, and the free-list links of those that are free. It then spends
+ * about MM_CHECK_BUDGET nanoseconds advancing two cursors, one walking the
+ * heap in memory order and one walking the free lists, so that over many
+ * calls the whole heap is checked without any call paying for all of it.
+ *
+ * With deferred coalescing (see mm_defer_coalescing), a freed block of up
+ * to QUICK_MAX bytes is not coalesced but pushed, still marked allocated,
+ * on the quick list for its size, from which a request of exactly that
+ * size takes it back without a search or a split. The quick blocks are all
+ * freed for real (and coalesced) when a fit search fails, or when there
+ * are more than QUICK_LIMIT of them.
+ *
+ * mm_calloc clears only what may have been written before. Memory the heap
+ * grows over is zero when memlib has never handed it out (mem_fresh_lo).
+ * The range [zero_lo, zero_hi) records what of it is still untouched: it
+ * starts inside the free block made by the extension, and shrinks from
+ * below or above as blocks are carved from that block, so that it never
+ * covers an allocated block, or the header, links or footer of a free one
+ * (other than those of the free block holding it, which are at its edges).
+ * place() records which part of the block it placed came from the range,
+ * so that mm_calloc can skip clearing it.
+ *
+ * Once mm_realloc has resized a block MM_REALLOC_HOT times, it leaves
+ * headroom in it, so that the next grows find the room in place instead
+ * of copying the block: MM_REALLOC_SLACK percent more than the request,
+ * or with MM_REALLOC_ROOM == MM_ROOM_GEOMETRIC, the request rounded up to
+ * the next geometric size class (four per power of two). A hot block that
+ * shrinks keeps its headroom too, and only gives back what lies beyond it.
+ *
+ * mm_memalign allocates a block with room for the request plus the
+ * alignment, and then frees the fragment that precedes the aligned payload
+ * (made at least MIN_BLOCK bytes, so that it can be a free block) and any
+ * tail it does not need.
+ *
+ * mm_malloc_batch places the blocks of a batch as a single block, which it
+ * then cuts into equal blocks, so a batch costs one fit search and one
+ * split. mm_free_batch sorts its pointers and merges each run of adjacent
+ * blocks back into one allocated block before freeing it, so a run costs
+ * one coalesce.
+ *
+ * An arena is a chain of allocated blocks of at least ARENA_CHUNK bytes,
+ * obtained like any other block. The first one starts with the mm_arena
+ * itself; each later one starts with a pointer to the one before it.
+ * mm_arena_alloc bumps a pointer through the newest chunk, and resetting
+ * the arena frees all chunks but the first.
+ *
+ * The description above is of the default policies. config.h selects
+ * others at compile time: MM_INDEX_TREE keeps the large blocks in the
+ * tree, MM_FIT_FIRST takes the first fitting block on the way down the
+ * tree instead of the best one, MM_ORDER_FIFO and
+ * MM_ORDER_ADDRESS keep the exact lists in the order blocks were freed or
+ * in address order (the latter by walking the list on insertion),
+ * MM_GROW_CHUNK grows the heap by CHUNKSIZE steps, and MM_CHUNKSIZE and
+ * MM_SPLIT_MIN set the growth step and the smallest remainder worth
+ * splitting off.
  */
 
 #include <stdio.h>
@@ -53,6 +177,14 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
+
+#if MM_THREADS
+#include <pthread.h>
+#endif
+#if MM_CHECK
+#include <time.h>
+#endif
 
 /*********************************************************
  * NOTE: Before you do anything else, please
@@ -74,17 +206,24 @@ team_t team = {
 /* Basic constants and macros */
 #define WSIZE       8       /* word size (bytes) */  
 #define DSIZE       16      /* doubleword size (bytes) */
-#define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
-#define OVERHEAD    16      /* overhead of header and footer (bytes) */
+#define CHUNKSIZE  MM_CHUNKSIZE /* initial heap size and smallest growth step (bytes) */
+#define OVERHEAD    8       /* overhead of an allocated block's header (bytes) */
+#define TRIM_THRESHOLD (1<<20) /* first trim a free last block of at least this size (bytes) */
+#define GROW_SHIFT  5       /* extend the heap by at least 1/32 of its size */
+#define TRIM_KEEP   (16 * CHUNKSIZE) /* bytes of a trimmed block that stay in the heap */
+#define TRIM_DELAY  (1<<16) /* frees since the heap last grew before it is trimmed */
 
 /* NOTE: feel free to replace these macros with helper functions and/or 
  * add new ones that will be useful for you. Just make sure you think 
  * carefully about why these work the way they do
  */
 
-/* Pack a size and allocated bit into a word */
+/* Pack a size and allocated bits into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
+/* Header bit recording that the previous block in memory is allocated */
+#define PREV_ALLOC   0x2
+
 /* Read and write a word at address p */
 #define GET(p)       (*(size_t *)(p))
 #define PUT(p, val)  (*(size_t *)(p) = (val))
@@ -96,18 +235,89 @@ team_t team = {
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0xf)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Read and write the realloc count in the header of allocated block bp */
+#define REALLOC_BITS 0xc
+#define GET_REALLOCS(bp)    ((GET(HDRP(bp)) & REALLOC_BITS) >> 2)
+#define SET_REALLOCS(bp, n) PUT(HDRP(bp), (GET(HDRP(bp)) & ~REALLOC_BITS) | ((size_t)(n) << 2))
+
+/* Read and write a word that tcache_free may read without the lock */
+#define GET_SHARED(p)      __atomic_load_n((size_t *)(p), __ATOMIC_RELAXED)
+#define PUT_SHARED(p, val) __atomic_store_n((size_t *)(p), (val), __ATOMIC_RELAXED)
+
+/* Set or clear the previous-allocated bit in the header of block bp, which
+ * may be allocated and being freed by another thread: only writers hold
+ * the lock, so the two steps need not be one atomic operation */
+#define SET_PREV_ALLOC(bp)   PUT_SHARED(HDRP(bp), GET_SHARED(HDRP(bp)) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(bp) PUT_SHARED(HDRP(bp), GET_SHARED(HDRP(bp)) & ~PREV_ALLOC)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Given block ptr bp, compute address of its header and footer (free blocks only) */
 #define HDRP(bp)       (PSUB(bp, WSIZE))
 #define FTRP(bp)       (PADD(bp, GET_SIZE(HDRP(bp)) - DSIZE))
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks
+ * (PREV_BLKP only works when the previous block is free) */
 #define NEXT_BLKP(bp)  (PADD(bp, GET_SIZE(HDRP(bp))))
 #define PREV_BLKP(bp)  (PSUB(bp, GET_SIZE((PSUB(bp, DSIZE)))))
 
-/* Returns (pointer to) pointer to the head node of explicit free list  */
-#define HEAD         (* (void**)PSUB(heap_start, DSIZE))
-#define HEAD_PTR     ((void*) PSUB(heap_start, DSIZE))
+/* Segregated free lists */
+#define MIN_BLOCK    32                 /* smallest block size (bytes) */
+#define SMALL_LIMIT  256                /* largest size with an exact class (bytes) */
+#define NUM_SMALL    ((SMALL_LIMIT - MIN_BLOCK) / DSIZE + 1) /* number of exact classes */
+#define NUM_CLASSES  (NUM_SMALL + 1)    /* exact classes, then the large blocks */
+#define SPLIT_MIN    MM_SPLIT_MIN       /* smallest remainder split off a block (bytes) */
+
+#if MM_LIST_ORDER == MM_ORDER_FIFO
+#define LIST_WORDS   ((NUM_CLASSES + NUM_SMALL) | 1) /* words before the prologue: heads, then tails */
+#else
+#define LIST_WORDS   (NUM_CLASSES | 1)  /* words before the prologue (odd keeps alignment) */
+#endif
+
+/* Returns (an lvalue for) the head of the free list for size class cls */
+#define LIST_HEAD(cls)  (free_lists[cls])
+
+#if MM_LIST_ORDER == MM_ORDER_FIFO
+/* Returns (an lvalue for) the last block of the list for exact class cls */
+#define LIST_TAIL(cls)  (free_lists[NUM_CLASSES + (cls)])
+#endif
+
+#if SPLIT_MIN < MIN_BLOCK || SPLIT_MIN % DSIZE != 0
+#error "MM_SPLIT_MIN must be a multiple of 16 of at least 32"
+#endif
+#if CHUNKSIZE < MIN_BLOCK || CHUNKSIZE % DSIZE != 0 || TRIM_KEEP >= TRIM_THRESHOLD
+#error "MM_CHUNKSIZE must be a multiple of 16 of at least 32, below TRIM_THRESHOLD / 16"
+#endif
+
+#if MM_REALLOC_HOT < 1 || MM_REALLOC_HOT > 3
+#error "MM_REALLOC_HOT must be 1, 2 or 3"
+#endif
+
+#if NUM_CLASSES != MM_NUM_CLASSES
+#error "MM_NUM_CLASSES in mm.h must match NUM_CLASSES"
+#endif
+
+/* Returns (an lvalue for) the root of the large-block tree */
+#define TREE_ROOT  LIST_HEAD(NUM_SMALL)
+
+/* Given free block ptr bp in the tree, compute (lvalues for) its children and height */
+#define TREE_LEFT(bp)    (* (void**) (bp))
+#define TREE_RIGHT(bp)   (* (void**) PADD(bp, WSIZE))
+#define TREE_HEIGHT(bp)  (* (size_t*) PADD(bp, DSIZE))
+
+/* Height of a (possibly empty) subtree */
+#define HEIGHT(bp)  ((bp) == NULL ? 0 : TREE_HEIGHT(bp))
+
+/* Is free block a ordered before free block b in the tree? */
+#define TREE_LESS(a, b)  (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+                          (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (char *)(a) < (char *)(b)))
+
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+/* Most large free blocks the index array holds before they move to the
+ * tree, and the count at which they move back */
+#define INDEX_SMALL  512
+#define INDEX_BACK   (INDEX_SMALL / 4)
+#endif
 
 /* Given free block ptr bp, compute next free block and previous free block in list */
 #define NEXT_FREE_BLKP(bp)  (* (void**) bp)
@@ -122,35 +332,291 @@ team_t team = {
 // Pointer to first block
 static void *heap_start = NULL;
 
+// Array of free list heads, one per size class, stored before the prologue
+static void **free_lists = NULL;
+
+// Counters reported by mm_stats
+static mm_stats_t heap_stats;
+
+// Size of a free last block that gets trimmed, the bytes the last trim
+// gave back (0 once the heap has grown again), and the blocks freed since
+// the heap last grew
+static size_t trim_threshold;
+static size_t trimmed;
+static size_t trim_frees;
+
+/* Fresh memory */
+#define LINK_BYTES  (3 * WSIZE)  /* bytes of a free block's payload holding its links or tree node */
+
+// Bytes known to be zero: empty if zero_lo >= zero_hi. Otherwise they lie
+// in one free block, at least LINK_BYTES past the start of its payload and
+// before its footer.
+static char *zero_lo, *zero_hi;
+
+// The part [placed_zero_lo, placed_zero_hi) of the block place() last
+// allocated that came from that range (empty if none did)
+static char *placed_zero_lo, *placed_zero_hi;
+
+/* Deferred coalescing */
+#define QUICK_MAX    SMALL_LIMIT  /* largest block size held on quick lists (bytes) */
+#define QUICK_LIMIT  512          /* blocks held before they are all coalesced */
+
+// Is coalescing deferred? And the freed blocks awaiting it, by size class,
+// linked through their first payload word
+static bool defer_coalescing;
+static void *quick_lists[NUM_SMALL];
+static int quick_count;
+
+/* Realloc headroom */
+#define REALLOC_MAX  3  /* largest realloc count a header holds (see MM_REALLOC_HOT) */
+
+// Does mm_realloc leave headroom in blocks it has resized before?
+static bool realloc_room = true;
+
+/* Slab pages for small requests */
+#define SLAB_MAX      64                 /* largest request served from slab pages (bytes) */
+#define SLAB_CLASSES  (SLAB_MAX / DSIZE) /* one class per slot size */
+#define SLAB_PAGE     (1<<12)            /* size and alignment of a slab page (bytes) */
+#define SLAB_HDR      64                 /* bytes at the start of a page used by its slab_t */
+#define SLAB_BLOCK    (SLAB_PAGE + DSIZE) /* size of the heap block holding a page */
+#define SLAB_WARMUP   32                 /* requests per class served as blocks before the first page */
+#define SLAB_BITS     (8 * sizeof(size_t)) /* slots tracked per bitmap word */
+#define SLAB_WORDS    ((SLAB_PAGE - SLAB_HDR) / DSIZE / SLAB_BITS + 1) /* bitmap words per page */
+
+/* Given a request size (at most SLAB_MAX), compute its slab class */
+#define SLAB_CLASS(size)  (((size) - 1) / DSIZE)
+
+/* Given a pointer to a slot, compute (the slab_t at the start of) its page */
+#define SLAB_PAGEP(bp)  ((slab_t *)((size_t)(bp) & ~(size_t)(SLAB_PAGE - 1)))
+
+typedef struct slab {
+    struct slab *next;         /* next page of this class with free slots */
+    struct slab *prev;         /* previous page of this class with free slots */
+    unsigned size;             /* slot size (bytes) */
+    unsigned nslots;           /* number of slots in the page */
+    unsigned nfree;            /* number of those slots not in use */
+    size_t used[SLAB_WORDS];   /* bit i is set if slot i is in use (or does not exist) */
+} slab_t;
+
+// Pages with free slots, per slab class
+static slab_t *slab_lists[SLAB_CLASSES];
+
+// Requests seen per class while it had no page (see SLAB_WARMUP)
+static int slab_demand[SLAB_CLASSES];
+
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+// The large free blocks, sorted by size and then address, with their sizes
+// in an array of their own so that searches touch only it, while there
+// are at most INDEX_SMALL of them; beyond that (index_tree) they are in
+// the tree at TREE_ROOT
+static size_t index_sizes[INDEX_SMALL];
+static void *index_blocks[INDEX_SMALL];
+static size_t index_count;
+static bool index_tree;
+#endif
+
+// One bit per SLAB_PAGE of the heap, set for the pages that are slab pages
+static unsigned char slab_map[MAX_HEAP / SLAB_PAGE / 8 + 1];
+static size_t heap_first_page; /* page number of the first byte of the heap */
+
+/* Arenas */
+#define ARENA_CHUNK  (16 * CHUNKSIZE) /* usual size of an arena chunk (bytes) */
+#define ARENA_OWN    (ARENA_CHUNK / 4) /* larger requests get a chunk of their own (bytes) */
+
+struct mm_arena {
+    void *chunks;    /* newest chunk after the first, which links to the one before */
+    char *next;      /* next free byte of the chunk being filled */
+    char *end;       /* end of that chunk's payload */
+    char *start;     /* first byte after the mm_arena in the first chunk */
+};
+#define ARENA_HDR    (DSIZE * ((sizeof(struct mm_arena) + DSIZE - 1) / DSIZE)) /* bytes before the first allocation */
+
+#if MM_THREADS
+/* Per-thread caches */
+#define TCACHE_MAX    1024  /* largest request size served from thread caches (bytes) */
+#define TCACHE_BINS   (TCACHE_MAX / DSIZE) /* one bin per 16 bytes of request size */
+#define TCACHE_COUNT  32    /* max blocks held per bin */
+#define TCACHE_BATCH  16    /* blocks moved per refill or flush */
+
+/* Given a request size, compute the bin whose blocks can hold it */
+#define TCACHE_BIN(size)  (((size) - 1) / DSIZE)
+
+/* Given the size of a block, compute the bin it can be cached in
+ * (the largest one whose requests fit in its payload) */
+#define TCACHE_BLOCK_BIN(asize)  ((asize) / DSIZE - 2)
+
+typedef struct {
+    unsigned generation;                      /* heap generation the blocks belong to */
+    int count[TCACHE_BINS];                   /* number of blocks held in each bin */
+    void *blocks[TCACHE_BINS][TCACHE_COUNT];  /* cached blocks, used as a stack */
+} tcache_t;
+
+// Lock protecting the shared heap, and the calling thread's cache
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread tcache_t tcache;
+
+// Bumped by mm_init, so caches left over from an earlier heap are dropped
+static unsigned heap_generation = 1;
+
+// Blocks freed while the lock was held, linked through their first payload
+// word, waiting for the next allocation under the lock to free them
+static void *remote_frees;
+
+// Key whose destructor returns a thread's cached blocks when it exits
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+#define LOCK()    pthread_mutex_lock(&heap_lock)
+#define UNLOCK()  pthread_mutex_unlock(&heap_lock)
+#define TRYLOCK() (pthread_mutex_trylock(&heap_lock) == 0)
+
+/* Free the blocks other threads pushed on remote_frees (lock held) */
+#define REMOTE_DRAIN() \
+    if (__atomic_load_n(&remote_frees, __ATOMIC_RELAXED) != NULL) remote_drain()
+#else
+#define LOCK()
+#define UNLOCK()
+#define REMOTE_DRAIN()
+#endif
+
+#if MM_CHECK
+/* Incremental checker */
+#define CHECK_BATCH  8  /* blocks each cursor checks between clock reads */
+
+// Next block of the heap walk (NULL: start over), and next node of the
+// free list walk (NULL: move on to the next list) with the class of its list
+static void *check_cursor;
+static void *check_list_cursor;
+static int check_list_cls;
+
+/* Check the blocks around bp after an operation on it */
+#define CHECK_OP(bp)  check_op(__LINE__, bp)
+
+/* Keep the cursors on live blocks: bp is being merged into block into,
+ * or taken off its free list */
+#define CHECK_MERGE(bp, into)  do { if (check_cursor == (bp)) check_cursor = (into); } while (0)
+#define CHECK_UNLINK(bp)  do { if (check_list_cursor == (bp)) check_list_cursor = NEXT_FREE_BLKP(bp); } while (0)
+#else
+#define CHECK_OP(bp)
+#define CHECK_MERGE(bp, into)
+#define CHECK_UNLINK(bp)
+#endif
+
 /* Function prototypes for internal helper routines */
 
 static bool check_heap(int lineno);
 static void print_heap();
 static void print_block(void *bp);
+static void print_tree(void *bp);
 static bool check_block(int lineno, void *bp);
 static void *extend_heap(size_t size);
+static size_t grow_size(size_t asize);
 static void *find_fit(size_t asize);
 static void *coalesce(void *bp);
-static void place(void *bp, size_t asize);
+static void *place(void *bp, size_t asize);
+static int size_class(size_t size);
+static void *tree_insert(void *root, void *bp);
+static void *tree_remove(void *root, void *bp);
+static void *tree_fit(size_t asize);
+static void *tree_balance(void *bp);
+static void *tree_rotate(void *bp, bool right);
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+static size_t index_find(size_t size, void *bp);
+static void index_insert(void *bp);
+static void index_remove(void *bp);
+static void *index_to_tree(size_t lo, size_t hi);
+static void tree_to_index(void *bp);
+#endif
+static size_t adjust_size(size_t size);
+static void trim_block(void *bp, size_t asize);
+static void *alloc_block(size_t asize);
+static void free_block(void *bp);
+static void quick_flush(void);
+static void trim_heap(void *bp);
+static bool resize_block(void *bp, size_t asize, size_t room);
+static size_t headroom(size_t asize, size_t reallocs);
+static void *alloc_payload(size_t size);
+static void free_payload(void *bp);
+static bool is_slab(void *bp);
+static void set_slab(slab_t *sp, bool slab);
+static void *slab_alloc(int cls);
+static void slab_free(void *bp);
+static slab_t *slab_new_page(int cls);
+static void *slab_fit(size_t *gap);
+static void slab_link(slab_t *sp);
+static void slab_unlink(slab_t *sp);
+#if MM_THREADS
+static tcache_t *get_tcache(void);
+static void *tcache_malloc(size_t size);
+static bool tcache_free(void *bp);
+static void tcache_flush(tcache_t *tc, int bin, int n);
+static void remote_push(void *first, void *last);
+static void remote_drain(void);
+#endif
+#if MM_CHECK
+static void check_op(int line, void *bp);
+static bool check_local(int line, void *bp);
+static bool check_links(int line, void *bp);
+static bool check_step(int line);
+static bool in_heap(void *p);
+#endif
+static int compare_ptrs(const void *a, const void *b);
 static size_t max(size_t x, size_t y);
+static size_t min(size_t x, size_t y);
 
 /* 
- * mm_init -- <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * mm_init -- Sets up an empty heap: the free list heads, the prologue and
+ *            epilogue, and a first free block of CHUNKSIZE bytes
+ * Takes no arguments.
+ * Returns 0, or -1 if the heap cannot grow
+ * Must be called after mem_init and before any other mm call. It also
+ * resets the allocator's counters, slab pages and quick lists, so calling
+ * it again starts over with an empty heap (and, with MM_THREADS, makes
+ * every thread drop the blocks it has cached).
  */
 int mm_init(void) {
+    int cls;
+
     /* create the initial empty heap */
-    if ((heap_start = mem_sbrk(4 * WSIZE)) == NULL)
+    if ((long)(heap_start = mem_sbrk((LIST_WORDS + 3) * WSIZE)) < 0)
         return -1;
+
+    /* empty list heads --- also serve as alignment padding, neither prologue nor epilogue */
+    free_lists = heap_start;
+    for (cls = 0; cls < LIST_WORDS; cls++)
+        LIST_HEAD(cls) = NULL;
+    heap_start = PADD(heap_start, LIST_WORDS * WSIZE);
+
+    PUT(heap_start, PACK(DSIZE, 1 | PREV_ALLOC));              /* prologue header */
+    PUT(PADD(heap_start, WSIZE), PACK(DSIZE, 1));              /* prologue footer */
+    PUT(PADD(heap_start, DSIZE), PACK(0, 1 | PREV_ALLOC));     /* epilogue header */
     
-    PUT(heap_start, 0);                        /* alignment padding --- 8 bytes, neither prologue nor epilogue */
-    PUT(PADD(heap_start, WSIZE), PACK(OVERHEAD, 1));  /* prologue header */
-    PUT(PADD(heap_start, DSIZE), PACK(OVERHEAD, 1));  /* prologue footer */
-    PUT(PADD(heap_start, WSIZE + DSIZE), PACK(0, 1));   /* epilogue header */
-    
-    heap_start = PADD(heap_start, DSIZE); /* start the heap at the (size 0) payload of the prologue block */
+    heap_start = PADD(heap_start, WSIZE); /* start the heap at the (size 0) payload of the prologue block */
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+    index_count = 0;
+    index_tree = false;
+#endif
+
+    memset(&heap_stats, 0, sizeof(heap_stats));
+    trim_threshold = TRIM_THRESHOLD;
+    trimmed = 0;
+    trim_frees = 0;
+    memset(quick_lists, 0, sizeof(quick_lists));
+    quick_count = 0;
+
+    /* no slab pages yet */
+    memset(slab_lists, 0, sizeof(slab_lists));
+    memset(slab_demand, 0, sizeof(slab_demand));
+    memset(slab_map, 0, sizeof(slab_map));
+    heap_first_page = (size_t)mem_heap_lo() / SLAB_PAGE;
+
+#if MM_THREADS
+    heap_generation++;  /* blocks cached by any thread belonged to the old heap */
+    remote_frees = NULL;  /* and so did any blocks waiting to be freed */
+#endif
+#if MM_CHECK
+    check_cursor = check_list_cursor = NULL;
+#endif
 
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
@@ -159,318 +625,1916 @@ int mm_init(void) {
     return 0;
 }
 
+/*
+ * print_tree -- Prints the blocks of a subtree of the large-block tree in order
+ */
+static void print_tree(void *bp) {
+    if (bp == NULL)
+        return;
+    print_tree(TREE_LEFT(bp));
+    print_block(bp);
+    print_tree(TREE_RIGHT(bp));
+}
+
 static void print_free_list() {
     char *bp;
-    char *bp_prev = NULL;
+    char *bp_prev;
+    int cls;
 
-    printf("Free List (%p):\n", HEAD);
-    if (HEAD == NULL) {
-        return;
-    }
-    for (bp = HEAD; NEXT_FREE_BLKP(bp) != NULL; bp = NEXT_FREE_BLKP(bp)) {
-        if (bp == bp_prev) {
-            printf("Something blew up at [%p], after [%p] \n", bp, bp_prev);
-            exit(0);
+    for (cls = 0; cls < NUM_SMALL; cls++) {
+        printf("Free List %d (%p):\n", cls, LIST_HEAD(cls));
+        bp_prev = NULL;
+        for (bp = LIST_HEAD(cls); bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+            if (bp == bp_prev) {
+                printf("Something blew up at [%p], after [%p] \n", bp, bp_prev);
+                exit(0);
+            }
+            bp_prev = bp;
+            print_block(bp);
         }
-        bp_prev = bp;
-        print_block(bp);
     }
-    print_block(bp);
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+    if (!index_tree) {
+        printf("Large-block index (%zu blocks):\n", index_count);
+        for (size_t i = 0; i < index_count; i++)
+            print_block(index_blocks[i]);
+        return;
+    }
+#endif
+    printf("Large-block tree (%p):\n", TREE_ROOT);
+    print_tree(TREE_ROOT);
 }
 
 /* 
- * add_to_list -- Adds a free block into the explicit free list
- * Takes a pointer to a coalesced block and adds it to the explicit free list
+ * add_to_list -- Adds a free block into the free list for its size class
+ * Takes a pointer to a coalesced block and pushes it on the head of the list
+ * for the class of its size, or inserts it in the large-block index (or tree) if it is large.
  * Returns nothing
- * The input block must be a free block
+ * The input block must be a free block whose header holds its final size
  */
 static void add_to_list(void *bp) {
-    if (HEAD != NULL) {
-        PUT(PREV_FREE_BLKP_POS(HEAD), (size_t) bp);
+    int cls = size_class(GET_SIZE(HDRP(bp)));
+    void *prev = NULL, *next;
+
+    heap_stats.free_bytes += GET_SIZE(HDRP(bp));
+    heap_stats.free_blocks[cls]++;
+    if (cls == NUM_SMALL) {
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+        if (!index_tree && index_count < INDEX_SMALL) {
+            index_insert(bp);
+            return;
+        }
+        if (!index_tree) {
+            TREE_ROOT = index_to_tree(0, index_count);
+            index_tree = true;
+        }
+#endif
+        TREE_ROOT = tree_insert(TREE_ROOT, bp);
+        return;
     }
-    PUT(NEXT_FREE_BLKP_POS(bp), (size_t) HEAD);
-    PUT(PREV_FREE_BLKP_POS(bp), (size_t) NULL);
-    PUT(HEAD_PTR, (size_t) bp);
+
+    /* Find the block to insert bp after (NULL: at the head) */
+#if MM_LIST_ORDER == MM_ORDER_FIFO
+    prev = LIST_TAIL(cls);
+#elif MM_LIST_ORDER == MM_ORDER_ADDRESS
+    for (next = LIST_HEAD(cls); next != NULL && (char *)next < (char *)bp; next = NEXT_FREE_BLKP(next))
+        prev = next;
+#endif
+    next = (prev == NULL) ? LIST_HEAD(cls) : NEXT_FREE_BLKP(prev);
+
+    PUT(NEXT_FREE_BLKP_POS(bp), (size_t) next);
+    PUT(PREV_FREE_BLKP_POS(bp), (size_t) prev);
+    if (prev == NULL)
+        LIST_HEAD(cls) = bp;
+    else
+        PUT(NEXT_FREE_BLKP_POS(prev), (size_t) bp);
+    if (next != NULL)
+        PUT(PREV_FREE_BLKP_POS(next), (size_t) bp);
+#if MM_LIST_ORDER == MM_ORDER_FIFO
+    else
+        LIST_TAIL(cls) = bp;
+#endif
 }
 
 /* 
- * remove_from_list -- Removes a free block into the explicit free list
- * Takes a pointer to a free block and removes it from the explicit free list
+ * remove_from_list -- Removes a free block from the free list for its size class
+ * Takes a pointer to a free block and unlinks it from its neighbors in the list
  * Returns nothing
- * The input block must be a free block
+ * The input block must be a free block whose header still holds the size it
+ * was added to the list with
  */
 static void remove_from_list(void *bp) {
-    // If the block is head
-    if (bp == HEAD && NEXT_FREE_BLKP_POS(bp) != NULL) {
-        PUT(HEAD_PTR, (size_t) NEXT_FREE_BLKP(bp));
-    } 
-    else if (bp == HEAD && NEXT_FREE_BLKP_POS(bp) == NULL) {
-        PUT(bp, 0);
-    
-    } 
-    // Block is not the head
-    else {
-        if (NEXT_FREE_BLKP(bp) != NULL) {
-            PUT(PREV_FREE_BLKP_POS(NEXT_FREE_BLKP(bp)), (size_t)PREV_FREE_BLKP(bp));
+    void *next = NEXT_FREE_BLKP(bp);
+    void *prev = PREV_FREE_BLKP(bp);
+
+    CHECK_UNLINK(bp);
+    heap_stats.free_bytes -= GET_SIZE(HDRP(bp));
+    heap_stats.free_blocks[size_class(GET_SIZE(HDRP(bp)))]--;
+    if (GET_SIZE(HDRP(bp)) > SMALL_LIMIT) {
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+        if (!index_tree) {
+            index_remove(bp);
+            return;
         }
-        PUT(NEXT_FREE_BLKP_POS(PREV_FREE_BLKP(bp)), (size_t) NEXT_FREE_BLKP(bp));
+#endif
+        TREE_ROOT = tree_remove(TREE_ROOT, bp);
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+        if (heap_stats.free_blocks[NUM_SMALL] <= INDEX_BACK) {
+            index_count = 0;
+            tree_to_index(TREE_ROOT);
+            index_tree = false;
+        }
+#endif
+        return;
+    }
 
+    // If the block is head, the list now starts at its successor
+    if (prev == NULL) {
+        LIST_HEAD(size_class(GET_SIZE(HDRP(bp)))) = next;
+    } 
+    else {
+        PUT(NEXT_FREE_BLKP_POS(prev), (size_t) next);
+    }
+    if (next != NULL) {
+        PUT(PREV_FREE_BLKP_POS(next), (size_t) prev);
+    }
+#if MM_LIST_ORDER == MM_ORDER_FIFO
+    else {
+        LIST_TAIL(size_class(GET_SIZE(HDRP(bp)))) = prev;
     }
+#endif
 }
 
-
 /* 
- * mm_malloc -- <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * size_class -- Maps a block size to the index of its segregated free list
+ * Sizes up to SMALL_LIMIT have one class per multiple of 16 bytes. All
+ * larger sizes share the last class, NUM_SMALL, which is the large-block index.
  */
-void *mm_malloc(size_t size) {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
-    char *bp;      
+static int size_class(size_t size) {
+    if (size <= SMALL_LIMIT)
+        return (size - MIN_BLOCK) / DSIZE;
+    return NUM_SMALL;
+}
 
-    /* Ignore spurious requests */
-    if (size <= 0)
-        return NULL;
-    
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE) {
-        asize = DSIZE + OVERHEAD;
-    } else {
-        /* Add overhead and then round up to nearest multiple of double-word alignment */
-        asize = DSIZE * ((size + (OVERHEAD) + (DSIZE - 1)) / DSIZE);
-    }
-    
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);            
+/*
+ * tree_insert -- Inserts free block bp in the subtree at root
+ * Returns the new root of the subtree
+ */
+static void *tree_insert(void *root, void *bp) {
+    if (root == NULL) {
+        TREE_LEFT(bp) = TREE_RIGHT(bp) = NULL;
+        TREE_HEIGHT(bp) = 1;
         return bp;
     }
-
-    /* No fit found. Get more memory and place the block */
-    extendsize = max(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
-        return NULL;
-    
-    place(bp, asize);
-    return bp;
+    if (TREE_LESS(bp, root))
+        TREE_LEFT(root) = tree_insert(TREE_LEFT(root), bp);
+    else
+        TREE_RIGHT(root) = tree_insert(TREE_RIGHT(root), bp);
+    return tree_balance(root);
 }
 
-/* 
- * mm_free -- <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+/*
+ * tree_remove -- Removes free block bp from the subtree at root
+ * Returns the new root of the subtree
+ * bp must be in the subtree, with the size it was inserted with
  */
-void mm_free(void *bp) {
-    /* Set the footer value to the size packed with 0
-     * Set the header value to the size packed with 0
-     * Coalesce the block
-     */
-    PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
-    PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
-    coalesce(bp);
+static void *tree_remove(void *root, void *bp) {
+    void *succ;
+
+    if (root != bp) {
+        if (TREE_LESS(bp, root))
+            TREE_LEFT(root) = tree_remove(TREE_LEFT(root), bp);
+        else
+            TREE_RIGHT(root) = tree_remove(TREE_RIGHT(root), bp);
+        return tree_balance(root);
+    }
+
+    if (TREE_LEFT(bp) == NULL)
+        return TREE_RIGHT(bp);
+    if (TREE_RIGHT(bp) == NULL)
+        return TREE_LEFT(bp);
+
+    /* Two children: the successor, the leftmost block on the right, takes
+     * the place of bp */
+    for (succ = TREE_RIGHT(bp); TREE_LEFT(succ) != NULL; succ = TREE_LEFT(succ))
+        ;
+    TREE_RIGHT(succ) = tree_remove(TREE_RIGHT(bp), succ);
+    TREE_LEFT(succ) = TREE_LEFT(bp);
+    return tree_balance(succ);
 }
 
 /*
- * EXTRA CREDIT
- * mm_realloc -- <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
-*/
-void *mm_realloc(void *ptr, size_t size) {
-    // TODO: implement this function for EXTRA CREDIT
-    return NULL;
-}
+ * tree_fit -- Returns the first block in tree order whose size is at
+ * least asize (with MM_FIT_FIRST, the first such block the search from
+ * the root comes across), or NULL if there is none
+ * With MM_INDEX_ARRAY, it takes the first such block of the index instead,
+ * unless the large blocks are in the tree for now.
+ */
+static void *tree_fit(size_t asize) {
+    void *best = NULL;
+    void *bp = TREE_ROOT;
 
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+    if (!index_tree) {
+        size_t i = index_find(asize, NULL);
 
-/* The remaining routines are internal helper routines */
+        if (i == index_count)
+            return NULL;
+        heap_stats.walked++;  /* the only block the search looks at */
+        return index_blocks[i];
+    }
+#endif
 
+    while (bp != NULL) {
+        heap_stats.walked++;
+        if (GET_SIZE(HDRP(bp)) >= asize) {
+#if MM_FIT == MM_FIT_FIRST
+            return bp;
+#endif
+            best = bp;
+            bp = TREE_LEFT(bp);
+        } else {
+            bp = TREE_RIGHT(bp);
+        }
+    }
+    return best;
+}
 
-/* 
- * place -- Place block of asize bytes at start of free block bp 
- *          and <How are you handling splitting?>
- * Takes a pointer to a free block and the size of block to place inside it
- * Returns nothing
- * <Are there any preconditions or postconditions?>
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+/*
+ * index_find -- Returns the position in the large-block index of the first
+ * block that is not ordered before a block of the given size at bp (NULL:
+ * before every block of that size), or index_count if there is none
+ * A binary search over index_sizes narrows the range to INDEX_SCAN blocks,
+ * which are then scanned in order; index_blocks is only read among
+ * blocks of the same size.
  */
-static void place(void *bp, size_t asize) {
+#define INDEX_SCAN 16
+static size_t index_find(size_t size, void *bp) {
+    size_t lo = 0, hi = index_count, mid;
 
-    /* Go to footer of bp. Subtract asize from it.
-     * Jump backwards by that amount - 8, put the footer value there.
-     * Jump backwards 8 bytes and put asize | 1 there.
-     * Go to the header of bp and put asize | 1 there.
-     */
-    // we shouldn't split if nextsize is smaller than 32
-    size_t nextsize = GET_SIZE(HDRP(bp)) - asize;
-    // If the remaining free block to be split is less than 32, don't split
-    remove_from_list(bp);
-    if (nextsize < DSIZE + OVERHEAD) {
-        PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 1));
-        PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 1));
-    } else {
-        PUT(FTRP(bp), nextsize); // Update footer of free to have updated size after splitting
-        PUT(PADD(bp, asize - WSIZE), nextsize); // Updating header of free block after splitting
-        add_to_list(PADD(bp, asize));
-        PUT(HDRP(bp), PACK(asize, 1)); // Update header of bp
-        PUT(FTRP(bp), PACK(asize, 1)); // Update footer of bp
+    while (hi - lo > INDEX_SCAN) {
+        mid = lo + (hi - lo) / 2;
+        if (index_sizes[mid] < size ||
+            (index_sizes[mid] == size && (char *)index_blocks[mid] < (char *)bp))
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    while (lo < hi && index_sizes[lo] < size)
+        lo++;
+    while (bp != NULL && lo < hi && index_sizes[lo] == size && (char *)index_blocks[lo] < (char *)bp)
+        lo++;
+    return lo;
 }
 
 /*
- * coalesce -- Boundary tag coalescing. 
- * Takes a pointer to a free block
- * Return ptr to coalesced block
- * <Are there any preconditions or postconditions?>
+ * index_insert -- Inserts free block bp in the large-block index
  */
-static void *coalesce(void *bp) {
-    /*
-     * Go to footer of previous block
-     * If free, set the header size to that size + coalesced block size
-     * Go to header of block after input block
-     * If free, get size of that block and add new block size to existing block size
-     * Go to the footer of the block to be coalesced and update the size 
-     */
-    void* coalesced_block = bp;
-    int was_on_list = 0;
-    if (!GET_ALLOC(HDRP(PREV_BLKP(bp)))) {
-        PUT(HDRP(PREV_BLKP(bp)), GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(bp)));
-        coalesced_block = PREV_BLKP(bp);
-        was_on_list = 1;
-    }
-    if (!GET_ALLOC(HDRP(NEXT_BLKP(coalesced_block)))) {
-        remove_from_list(NEXT_BLKP(coalesced_block));
-        PUT(HDRP(coalesced_block), GET_SIZE(HDRP(NEXT_BLKP(coalesced_block))) + GET_SIZE(HDRP(coalesced_block)));
-    }
-    PUT(FTRP(coalesced_block), GET(HDRP(coalesced_block)));
-    if (!was_on_list) {
-        add_to_list(coalesced_block);
+static void index_insert(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t i = index_count;
+
+    /* often the largest block, like the free space at the end of the heap */
+    if (i > 0 && (index_sizes[i - 1] > size ||
+                  (index_sizes[i - 1] == size && (char *)index_blocks[i - 1] > (char *)bp)))
+        i = index_find(size, bp);
+
+    if (i < index_count) {
+        memmove(&index_sizes[i + 1], &index_sizes[i], (index_count - i) * sizeof(size_t));
+        memmove(&index_blocks[i + 1], &index_blocks[i], (index_count - i) * sizeof(void *));
     }
-    return coalesced_block;
+    index_sizes[i] = size;
+    index_blocks[i] = bp;
+    index_count++;
 }
 
-/* 
- * find_fit - Find a fit for a block with asize bytes 
+/*
+ * index_remove -- Removes free block bp from the large-block index
+ * bp must be in the index, with the size it was inserted with
  */
-static void *find_fit(size_t asize) {
-    /* search from the start of the free list to the end */
-    for (char* bp = HEAD; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
-        if (asize <= GET_SIZE(HDRP(bp)))
-            return bp;
-    }
+static void index_remove(void *bp) {
+    size_t i = index_count - 1;
 
-    return NULL;  /* no fit found */
+    if (index_blocks[i] != bp)
+        i = index_find(GET_SIZE(HDRP(bp)), bp);
+
+    if (--index_count > i) {
+        memmove(&index_sizes[i], &index_sizes[i + 1], (index_count - i) * sizeof(size_t));
+        memmove(&index_blocks[i], &index_blocks[i + 1], (index_count - i) * sizeof(void *));
+    }
 }
 
-/* 
- * extend_heap - Extend heap with free block and return its block pointer
+/*
+ * index_to_tree -- Builds a balanced tree of the index entries lo to hi - 1
+ * Returns its root
  */
-static void *extend_heap(size_t words) {
-    char *bp;
-    size_t size;
-    
-    /* Allocate an even number of words to maintain alignment */
-    size = words * WSIZE;
-    if (words % 2 == 1)
-        size += WSIZE;
-    if ((long)(bp = mem_sbrk(size)) < 0) 
-        return NULL;
-
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header --- replaces old epilogue */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer  --- one block after b/c replaces epilogue*/
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header  --- in remaining block*/
+static void *index_to_tree(size_t lo, size_t hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    void *bp;
 
-    /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    if (lo == hi)
+        return NULL;
+    bp = index_blocks[mid];
+    TREE_LEFT(bp) = index_to_tree(lo, mid);
+    TREE_RIGHT(bp) = index_to_tree(mid + 1, hi);
+    TREE_HEIGHT(bp) = 1 + max(HEIGHT(TREE_LEFT(bp)), HEIGHT(TREE_RIGHT(bp)));
+    return bp;
 }
 
-/* 
- * check_heap -- Performs basic heap consistency checks for an implicit free list allocator 
- * and prints out all blocks in the heap in memory order. 
- * Checks include proper prologue and epilogue, alignment, and matching header and footer
- * Takes a line number (to give the output an identifying tag).
+/*
+ * tree_to_index -- Appends the blocks of the subtree at bp to the index in order
  */
-static bool check_heap(int line) {
-    char *bp;
+static void tree_to_index(void *bp) {
+    if (bp == NULL)
+        return;
+    tree_to_index(TREE_LEFT(bp));
+    index_sizes[index_count] = GET_SIZE(HDRP(bp));
+    index_blocks[index_count++] = bp;
+    tree_to_index(TREE_RIGHT(bp));
+}
+#endif
 
-    if ((GET_SIZE(HDRP(heap_start)) != DSIZE) || !GET_ALLOC(HDRP(heap_start))) {
-        printf("(check_heap at line %d) Error: bad prologue header\n", line);
-        return false;
-    }
+/*
+ * tree_balance -- Restores the AVL property at bp, whose subtrees are
+ * balanced and differ in height by at most two, and updates its height
+ * Returns the new root of the subtree
+ */
+static void *tree_balance(void *bp) {
+    long diff = (long)HEIGHT(TREE_LEFT(bp)) - (long)HEIGHT(TREE_RIGHT(bp));
 
-    for (bp = heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        if (!check_block(line, bp)) {
-            return false;
-        }
+    if (diff > 1) {
+        if (HEIGHT(TREE_LEFT(TREE_LEFT(bp))) < HEIGHT(TREE_RIGHT(TREE_LEFT(bp))))
+            TREE_LEFT(bp) = tree_rotate(TREE_LEFT(bp), false);
+        return tree_rotate(bp, true);
     }
-    
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {
-        printf("(check_heap at line %d) Error: bad epilogue header\n", line);
-        return false;
+    if (diff < -1) {
+        if (HEIGHT(TREE_RIGHT(TREE_RIGHT(bp))) < HEIGHT(TREE_LEFT(TREE_RIGHT(bp))))
+            TREE_RIGHT(bp) = tree_rotate(TREE_RIGHT(bp), true);
+        return tree_rotate(bp, false);
     }
-
-    return true;
+    TREE_HEIGHT(bp) = 1 + max(HEIGHT(TREE_LEFT(bp)), HEIGHT(TREE_RIGHT(bp)));
+    return bp;
 }
 
 /*
- * check_block -- Checks a block for alignment and matching header and footer
+ * tree_rotate -- Rotates the subtree at bp right (lifting its left child)
+ * or left (lifting its right child)
+ * Returns the new root of the subtree
  */
-static bool check_block(int line, void *bp) {
-    if ((size_t)bp % DSIZE) {
-        printf("(check_heap at line %d) Error: %p is not double-word aligned\n", line, bp);
-        return false;
-    }
-    if (GET(HDRP(bp)) != GET(FTRP(bp))) {
-        printf("(check_heap at line %d) Error: header does not match footer\n", line);
-        return false;
+static void *tree_rotate(void *bp, bool right) {
+    void *child;
+
+    if (right) {
+        child = TREE_LEFT(bp);
+        TREE_LEFT(bp) = TREE_RIGHT(child);
+        TREE_RIGHT(child) = bp;
+    } else {
+        child = TREE_RIGHT(bp);
+        TREE_RIGHT(bp) = TREE_LEFT(child);
+        TREE_LEFT(child) = bp;
     }
-    return true;
+    TREE_HEIGHT(bp) = 1 + max(HEIGHT(TREE_LEFT(bp)), HEIGHT(TREE_RIGHT(bp)));
+    TREE_HEIGHT(child) = 1 + max(HEIGHT(TREE_LEFT(child)), HEIGHT(TREE_RIGHT(child)));
+    return child;
 }
 
-/*
- * print_heap -- Prints out the current state of the implicit free list
+
+/* 
+ * mm_malloc -- Allocates a block with at least size bytes of payload
+ * Takes the payload size in bytes.
+ * Returns a double-word aligned pointer to the payload, or NULL if size is 0
+ * or the heap cannot grow.
+ * Requests of up to SLAB_MAX bytes get a slot in a slab page.
+ * With MM_THREADS, small requests are served from the calling thread's cache.
  */
-static void print_heap() {
-    char *bp;
+void *mm_malloc(size_t size) {
+    char *bp;      
 
-    printf("Heap (%p):\n", heap_start);
-    printf("Free list head at (%p)\n", HEAD);
+    /* Ignore spurious requests */
+    if (size <= 0)
+        return NULL;
 
-    for (bp = heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        print_block(bp);
-    }
+#if MM_THREADS
+    if (size <= TCACHE_MAX)
+        return tcache_malloc(size);
+#endif
 
-    print_block(bp);    
+    LOCK();
+    bp = alloc_payload(size);
+    UNLOCK();
+    return bp;
 }
 
-/*
- * print_block -- Prints out the current state of a block
+/* 
+ * mm_free -- Frees a block returned by mm_malloc or mm_realloc
+ * Takes the payload pointer of an allocated block.
+ * Returns nothing
+ * With MM_THREADS, small blocks go back to the calling thread's cache, and
+ * other blocks wait on remote_frees if another thread holds the heap lock.
  */
-static void print_block(void *bp) {
-    size_t hsize, halloc, fsize, falloc;
-
-    hsize = GET_SIZE(HDRP(bp));
-    halloc = GET_ALLOC(HDRP(bp));  
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));  
-    
-    if (hsize == 0) {
-        printf("%p: End of free list\n", bp);
+void mm_free(void *bp) {
+#if MM_THREADS
+    if (tcache_free(bp))
+        return;
+    if (!TRYLOCK()) {
+        remote_push(bp, bp);
         return;
     }
+#else
+    LOCK();
+#endif
+    free_payload(bp);
+    UNLOCK();
+}
 
-    printf("%p: header: [%ld:%c] footer: [%ld:%c] next: [%p] prev: [%p]\n", bp, 
-       hsize, (halloc ? 'a' : 'f'), 
-       fsize, (falloc ? 'a' : 'f'), 
+/*
+ * EXTRA CREDIT
+ * mm_realloc -- Resizes the block at ptr to hold at least size bytes
+ * Takes a pointer returned by an earlier mm_malloc/mm_realloc (or NULL) and
+ * the new payload size.
+ * Returns a pointer to the resized block, which keeps the first
+ * min(size, old payload) bytes of the old block. Returns NULL if the heap
+ * cannot grow, in which case the old block is left untouched.
+ * The block is resized in place whenever possible (see resize_block); a
+ * slab slot stays in place as long as size fits in it. Only when that fails
+ * do we allocate a new block, copy the payload, and free the old one.
+ * A block resized often gets headroom (see headroom), if it can have it
+ * without growing the heap: a block at the end of the heap already grows
+ * in place, so it is extended by no more than the request.
+*/
+void *mm_realloc(void *ptr, size_t size) {
+    size_t oldpayload; /* current payload size */
+    size_t asize, roomy, reallocs = 0;
+    bool resized;
+    void *newp;
+
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+
+    if (is_slab(ptr)) {
+        oldpayload = SLAB_PAGEP(ptr)->size;
+        if (size <= oldpayload)
+            return ptr;
+    } else {
+        LOCK();
+        oldpayload = GET_SIZE(HDRP(ptr)) - OVERHEAD;
+        reallocs = GET_REALLOCS(ptr);
+        asize = adjust_size(size);
+        roomy = headroom(asize, reallocs);
+        heap_stats.reallocs++;
+        resized = resize_block(ptr, asize, roomy);
+        if (resized)
+            SET_REALLOCS(ptr, min(reallocs + 1, REALLOC_MAX));
+        UNLOCK();
+        if (resized)
+            return ptr;
+        size = roomy - OVERHEAD;
+    }
+
+    /* No room in place: allocate, copy, and free */
+    if ((newp = mm_malloc(size)) == NULL)
+        return NULL;
+    memcpy(newp, ptr, oldpayload);
+    mm_free(ptr);
+    if (!is_slab(newp)) {
+        LOCK();
+        SET_REALLOCS(newp, min(reallocs + 1, REALLOC_MAX));
+        heap_stats.realloc_moves++;
+        UNLOCK();
+    }
+    return newp;
+}
+
+
+/*
+ * mm_calloc -- Allocates zeroed memory for nmemb elements of size bytes
+ * each
+ * Returns the payload pointer, or NULL if nmemb or size is 0, their product
+ * overflows, or the heap cannot grow
+ * Only the bytes of the block that place() could not vouch for are cleared,
+ * so a request carved from memory the heap has just grown over costs little
+ * more than mm_malloc. With MM_THREADS, requests served from the thread's
+ * cache are always cleared.
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+    size_t bytes;
+    char *bp, *end, *lo, *hi;
+
+    if (nmemb == 0 || size == 0 || nmemb > MAX_HEAP / size)
+        return NULL;
+    bytes = nmemb * size;
+
+#if MM_THREADS
+    if (bytes <= TCACHE_MAX) {
+        if ((bp = tcache_malloc(bytes)) != NULL)
+            memset(bp, 0, bytes);
+        return bp;
+    }
+#endif
+
+    LOCK();
+    placed_zero_lo = placed_zero_hi = NULL;
+    bp = alloc_payload(bytes);
+    lo = placed_zero_lo;
+    hi = placed_zero_hi;
+    UNLOCK();
+    if (bp == NULL)
+        return NULL;
+
+    /* Clear what lies outside [lo, hi) */
+    end = bp + bytes;
+    if (hi <= bp || lo >= end) {
+        memset(bp, 0, bytes);
+    } else {
+        if (lo > bp)
+            memset(bp, 0, lo - bp);
+        if (hi < end)
+            memset(hi, 0, end - hi);
+    }
+    return bp;
+}
+
+/*
+ * mm_defer_coalescing -- Turns deferred coalescing on (defer != 0) or off
+ * Returns nothing
+ * Blocks on the quick lists when it is turned off are coalesced right away.
+ */
+void mm_defer_coalescing(int defer) {
+    LOCK();
+    if (!defer)
+        quick_flush();
+    defer_coalescing = defer != 0;
+    UNLOCK();
+}
+
+/*
+ * mm_realloc_headroom -- Turns realloc headroom on (room != 0) or off
+ * Returns nothing
+ * It is on by default; with MM_ROOM_NONE, there is no headroom either way.
+ * Blocks that already have headroom keep it until they are resized.
+ */
+void mm_realloc_headroom(int room) {
+    LOCK();
+    realloc_room = room != 0;
+    UNLOCK();
+}
+
+/*
+ * mm_memalign -- Allocates a block with at least size bytes of payload,
+ * aligned to a multiple of align
+ * Takes the alignment, which is rounded up to a power of two, and the
+ * payload size.
+ * Returns the payload pointer, or NULL if size is 0 or the heap cannot grow
+ * Requests that round up to a multiple of align of at most SLAB_MAX bytes
+ * take a slab slot of that size: it is a power of two, and slots of such
+ * sizes are aligned to their size.
+ */
+void *mm_memalign(size_t align, size_t size) {
+    size_t asize, oldsize, pow;
+    char *bp, *p;
+
+    if (size == 0 || size > MAX_HEAP || align > MAX_HEAP)
+        return NULL;
+    for (pow = DSIZE; pow < align; pow <<= 1)
+        ;
+    align = pow;
+    if (align == DSIZE)
+        return mm_malloc(size);
+
+    LOCK();
+    asize = (size + align - 1) & ~(align - 1); /* a power of two slot, if at most SLAB_MAX */
+    if (asize <= SLAB_MAX && (bp = slab_alloc(SLAB_CLASS(asize))) != NULL) {
+        UNLOCK();
+        return bp;
+    }
+
+    /* Enough room for any leading fragment: it is less than align bytes,
+     * or DSIZE more than align when it has to be lengthened to a block */
+    asize = adjust_size(size);
+    if ((bp = alloc_block(asize + align + DSIZE)) == NULL) {
+        UNLOCK();
+        return NULL;
+    }
+    p = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+    if (p != bp && p - bp < MIN_BLOCK)
+        p += align;
+    if (p != bp) {
+        PUT(HDRP(p), PACK(GET_SIZE(HDRP(bp)) - (p - bp), 1));
+        PUT(HDRP(bp), PACK(p - bp, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        free_block(bp);
+    }
+    oldsize = GET_SIZE(HDRP(p));
+    trim_block(p, asize);
+    heap_stats.live_bytes -= oldsize - GET_SIZE(HDRP(p));
+    CHECK_OP(p);
+    UNLOCK();
+    return p;
+}
+
+/*
+ * mm_aligned_alloc -- Like mm_memalign, but returns NULL unless align is
+ * a power of two, as C11 aligned_alloc may
+ */
+void *mm_aligned_alloc(size_t align, size_t size) {
+    if (align == 0 || (align & (align - 1)) != 0)
+        return NULL;
+    return mm_memalign(align, size);
+}
+
+/*
+ * mm_malloc_batch -- Allocates n blocks with at least size bytes of payload
+ * each, stored in ptrs[0..n-1] in address order
+ * Takes the payload size, the array to fill in, and the number of blocks.
+ * Returns n, or 0 if size or n is 0 or the heap cannot grow, in which case
+ * nothing is allocated.
+ * The batch is placed as one block of n times the block size, which is then
+ * cut up; the last block keeps whatever place left over. Batches skip slab
+ * pages and thread caches, but their blocks can be freed one at a time.
+ */
+size_t mm_malloc_batch(size_t size, void **ptrs, size_t n) {
+    size_t asize, total, i;
+    char *bp;
+
+    if (size == 0 || n == 0)
+        return 0;
+    asize = adjust_size(size);
+    if (asize < size || n > (size_t)MAX_HEAP / asize)
+        return 0;
+    total = asize * n;
+
+    LOCK();
+    if ((bp = alloc_block(total)) == NULL) {
+        UNLOCK();
+        return 0;
+    }
+    total = GET_SIZE(HDRP(bp));
+    for (i = 0; i < n - 1; i++) {
+        PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        ptrs[i] = bp;
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(total - (i + 1) * asize, 1 | PREV_ALLOC));
+    }
+    ptrs[n - 1] = bp;
+    CHECK_OP(ptrs[0]);
+    CHECK_OP(bp);
+    UNLOCK();
+    return n;
+}
+
+/*
+ * mm_free_batch -- Frees the blocks (or slab slots) ptrs[0..n-1]
+ * Takes an array of pointers returned by the mm routines, which it sorts,
+ * and its length. NULL entries are skipped.
+ * Returns nothing
+ * Each run of blocks that are adjacent in memory becomes a single
+ * allocated block before it is freed, so a run is coalesced only once.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    size_t i, size;
+    void *bp;
+
+    qsort(ptrs, n, sizeof(void *), compare_ptrs);
+    LOCK();
+    for (i = 0; i < n; i++) {
+        if ((bp = ptrs[i]) == NULL)
+            continue;
+        if (is_slab(bp)) {
+            slab_free(bp);
+            continue;
+        }
+        size = GET_SIZE(HDRP(bp));
+        while (i + 1 < n && ptrs[i + 1] == PADD(bp, size) && !is_slab(ptrs[i + 1])) {
+            CHECK_MERGE(ptrs[i + 1], bp);
+            size += GET_SIZE(HDRP(ptrs[++i]));
+        }
+        PUT(HDRP(bp), PACK(size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        free_block(bp);
+    }
+    UNLOCK();
+}
+
+/*
+ * mm_arena_create -- Creates an empty arena
+ * Returns the arena, or NULL if the heap cannot grow
+ * The arena lives at the start of its first chunk.
+ */
+mm_arena_t *mm_arena_create(void) {
+    mm_arena_t *arena;
+
+    LOCK();
+    arena = alloc_block(adjust_size(ARENA_CHUNK));
+    UNLOCK();
+    if (arena == NULL)
+        return NULL;
+    arena->chunks = NULL;
+    arena->start = arena->next = PADD(arena, ARENA_HDR);
+    arena->end = PADD(arena, GET_SIZE(HDRP(arena)) - OVERHEAD);
+    return arena;
+}
+
+/*
+ * mm_arena_alloc -- Allocates size bytes from arena
+ * Returns a double-word aligned pointer, or NULL if size is 0 or the heap
+ * cannot grow
+ * Requests that do not fit in the current chunk start a new one; requests
+ * of more than ARENA_OWN bytes get a chunk of their own, so that the
+ * current chunk is not abandoned for them.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size) {
+    char *bp;
+
+    if (size == 0 || size > MAX_HEAP)
+        return NULL;
+    size = DSIZE * ((size + DSIZE - 1) / DSIZE);
+    if (size <= (size_t)(arena->end - arena->next)) {
+        bp = arena->next;
+        arena->next += size;
+        return bp;
+    }
+
+    LOCK();
+    bp = alloc_block(adjust_size((size > ARENA_OWN ? size : ARENA_CHUNK) + DSIZE));
+    UNLOCK();
+    if (bp == NULL)
+        return NULL;
+    *(void **)bp = arena->chunks;
+    arena->chunks = bp;
+    if (size > ARENA_OWN)
+        return PADD(bp, DSIZE);
+    arena->next = PADD(bp, DSIZE + size);
+    arena->end = PADD(bp, GET_SIZE(HDRP(bp)) - OVERHEAD);
+    return PADD(bp, DSIZE);
+}
+
+/*
+ * mm_arena_reset -- Frees everything allocated from arena, which stays
+ * usable
+ * Returns nothing
+ * All chunks but the first go back to the heap under one lock acquisition.
+ */
+void mm_arena_reset(mm_arena_t *arena) {
+    void *bp, *next;
+
+    LOCK();
+    for (bp = arena->chunks; bp != NULL; bp = next) {
+        next = *(void **)bp;
+        free_block(bp);
+    }
+    UNLOCK();
+    arena->chunks = NULL;
+    arena->next = arena->start;
+    arena->end = PADD(arena, GET_SIZE(HDRP(arena)) - OVERHEAD);
+}
+
+/*
+ * mm_arena_destroy -- Frees arena and everything allocated from it
+ * Returns nothing
+ */
+void mm_arena_destroy(mm_arena_t *arena) {
+    mm_arena_reset(arena);
+    LOCK();
+    free_block(arena);
+    UNLOCK();
+}
+
+/*
+ * mm_stats -- Reports the counters kept on the state of the heap
+ * Takes a pointer to the struct to fill in.
+ * Returns nothing
+ * The counters are maintained as blocks change state, so this is cheap.
+ * Blocks held in thread caches (MM_THREADS) count as allocated.
+ */
+void mm_stats(mm_stats_t *stats) {
+    LOCK();
+    REMOTE_DRAIN();
+    *stats = heap_stats;
+    UNLOCK();
+}
+
+/*
+ * mm_heap_walk -- Visits every block of the heap in address order
+ * Takes the function to call on each block, and an argument to pass it.
+ * Returns nothing
+ * The prologue and epilogue are skipped. Blocks on the quick lists, in
+ * thread caches or waiting to be freed by the lock holder are allocated
+ * as far as their headers go, and are reported so.
+ */
+void mm_heap_walk(mm_visit_t visit, void *arg) {
+    char *bp;
+
+    LOCK();
+    REMOTE_DRAIN();
+    if (heap_start != NULL)
+        for (bp = NEXT_BLKP(heap_start); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+            visit(bp, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)) != 0, arg);
+    UNLOCK();
+}
+
+
+/* The remaining routines are internal helper routines */
+
+
+/*
+ * alloc_block -- Allocate a block of asize bytes from the heap
+ * Takes an adjusted block size (see adjust_size).
+ * Returns the payload pointer of the new block, or NULL if the heap cannot grow
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static void *alloc_block(size_t asize) {
+    char *bp;      
+
+    /* A quick block of the same size needs no placing */
+    if (asize <= QUICK_MAX && (bp = quick_lists[size_class(asize)]) != NULL) {
+        quick_lists[size_class(asize)] = *(void **)bp;
+        quick_count--;
+        SET_REALLOCS(bp, 0);
+        CHECK_OP(bp);
+        return bp;
+    }
+
+    /* Search the free lists for a fit, once the blocks freed by other
+     * threads meanwhile are back, coalescing any quick blocks if there is
+     * none */
+    REMOTE_DRAIN();
+    if ((bp = find_fit(asize)) == NULL && quick_count > 0) {
+        quick_flush();
+        bp = find_fit(asize);
+    }
+    if (bp == NULL) {
+        /* No fit found. Get more memory and place the block */
+        if ((bp = extend_heap(grow_size(asize) / WSIZE)) == NULL)
+            return NULL;
+    }
+
+    bp = place(bp, asize);
+    heap_stats.live_bytes += GET_SIZE(HDRP(bp));
+    CHECK_OP(bp);
+    return bp;
+}
+
+/*
+ * free_block -- Return an allocated block to the heap
+ * Takes the payload pointer of an allocated block.
+ * Returns nothing
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static void free_block(void *bp) {
+    /* Tell the next block that its predecessor is now free
+     * Coalesce the block, which writes its free header and footer
+     * If that leaves a large free block at the end of the heap, and the
+     * heap has not grown for a while, shrink it
+     */
+    heap_stats.live_bytes -= GET_SIZE(HDRP(bp));
+    CLEAR_PREV_ALLOC(NEXT_BLKP(bp));
+    bp = coalesce(bp);
+    trim_frees++;
+    if (GET_SIZE(HDRP(bp)) >= trim_threshold && trim_frees >= TRIM_DELAY &&
+        GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+        trim_heap(bp);
+    CHECK_OP(bp);
+}
+
+/*
+ * quick_flush -- Free (and coalesce) all blocks on the quick lists
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static void quick_flush(void) {
+    void *bp;
+    int cls;
+
+    for (cls = 0; cls < NUM_SMALL; cls++) {
+        while ((bp = quick_lists[cls]) != NULL) {
+            quick_lists[cls] = *(void **)bp;
+            free_block(bp);
+        }
+    }
+    quick_count = 0;
+}
+
+/*
+ * trim_heap -- Give the memory of free block bp, the last block of the
+ * heap, back to memlib, except for its first TRIM_KEEP bytes
+ * Returns nothing
+ * The bytes given back are remembered, so that extend_heap can raise
+ * trim_threshold if the heap needs them again.
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static void trim_heap(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if ((long)mem_sbrk(-(int)(size - TRIM_KEEP)) < 0)
+        return;
+    trimmed = size - TRIM_KEEP;
+    remove_from_list(bp);
+    PUT(HDRP(bp), PACK(TRIM_KEEP, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(TRIM_KEEP, 0));
+    if (zero_hi > FTRP(bp))
+        zero_hi = FTRP(bp);
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    add_to_list(bp);
+}
+
+/*
+ * resize_block -- Try to resize allocated block bp to asize bytes in place,
+ * keeping up to room (>= asize) bytes if it has them
+ * A shrink splits off the tail beyond room as a free block. A grow absorbs
+ * a free successor, and keeps as much of it as room asks for; failing
+ * that, when the block (or its free successor) sits at the end of the
+ * heap, extends the heap as grow_size would for the bytes asize needs
+ * past the block, but by no more than room asks for.
+ * Returns true if bp now has at least asize bytes, false if it was left as is
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static bool resize_block(void *bp, size_t asize, size_t room) {
+    size_t oldsize = GET_SIZE(HDRP(bp));
+    size_t total;      /* block size available in place */
+    void *next;
+    bool zeroed;       /* does the zero range lie in next? */
+
+    /* Shrinking (or same size): give back the tail */
+    if (asize <= oldsize) {
+        trim_block(bp, min(room, oldsize));
+        heap_stats.live_bytes -= oldsize - GET_SIZE(HDRP(bp));
+        CHECK_OP(bp);
+        return true;
+    }
+
+    /* Growing: see how much room the successors give us */
+    next = NEXT_BLKP(bp);
+    total = oldsize;
+    if (!GET_ALLOC(HDRP(next))) {
+        total += GET_SIZE(HDRP(next));
+        next = NEXT_BLKP(next);
+    }
+
+    /* next is now the first allocated block after bp. If it is the
+     * epilogue, extend the heap by a growth step, kept within room so that
+     * what the step reserves stays in bp as headroom: left as a free tail,
+     * a small request would take it and leave bp unable to grow in place.
+     * extend_heap coalesces the new space with any free block that
+     * directly follows bp. */
+    if (total < asize && GET_SIZE(HDRP(next)) == 0) {
+        if (extend_heap(max(min(room - total, grow_size(asize - oldsize)), MIN_BLOCK) / WSIZE) == NULL)
+            return false;
+        total = asize;
+    }
+
+    if (total < asize)
+        return false;
+
+    next = NEXT_BLKP(bp);
+    zeroed = zero_lo < zero_hi && zero_lo >= (char *)next && zero_lo < NEXT_BLKP(next);
+    remove_from_list(next);
+    CHECK_MERGE(next, bp);
+    PUT(HDRP(bp), PACK(oldsize + GET_SIZE(HDRP(next)), 1 | GET_PREV_ALLOC(HDRP(bp))));
+    SET_PREV_ALLOC(NEXT_BLKP(bp));
+    trim_block(bp, min(room, GET_SIZE(HDRP(bp))));
+    if (zeroed && zero_lo < PADD(NEXT_BLKP(bp), LINK_BYTES))
+        zero_lo = PADD(NEXT_BLKP(bp), LINK_BYTES);  /* as for a block placed at the bottom */
+    heap_stats.live_bytes += GET_SIZE(HDRP(bp)) - oldsize;
+    CHECK_OP(bp);
+    return true;
+}
+
+
+/*
+ * headroom -- The block size mm_realloc asks for a request of asize bytes
+ * (see adjust_size) into a block it has already resized reallocs times
+ * Returns asize plus headroom once the block is hot (and headroom is on),
+ * else asize
+ */
+static size_t headroom(size_t asize, size_t reallocs) {
+    size_t step;
+
+    if (MM_REALLOC_ROOM == MM_ROOM_NONE || !realloc_room || reallocs < MM_REALLOC_HOT)
+        return asize;
+#if MM_REALLOC_ROOM == MM_ROOM_GEOMETRIC
+    /* the classes between 2^k and 2^(k+1) are 2^(k-2) apart */
+    step = max((size_t)1 << (8 * sizeof(size_t) - 3 - __builtin_clzl(asize)), DSIZE);
+    return (asize + step) & ~(step - 1);
+#else
+    step = asize / 100 * MM_REALLOC_SLACK;
+    return asize + ((step + DSIZE - 1) & ~(size_t)(DSIZE - 1));
+#endif
+}
+
+
+/* 
+ * place -- Place block of asize bytes in free block bp, splitting off the
+ *          rest as a free block if it is at least SPLIT_MIN bytes
+ * Takes a pointer to a free block and the size of block to place inside it
+ * Returns the payload pointer of the allocated block: bp, or for a large
+ * block that was split from a block other than the last one, the top
+ * asize bytes of bp
+ * bp must be on its free list; the remainder is put on one
+ */
+static void *place(void *bp, size_t asize) {
+    size_t nextsize = GET_SIZE(HDRP(bp)) - asize;  /* size of the remainder */
+
+    /* Is the zero range in bp? */
+    bool zeroed = zero_lo < zero_hi && zero_lo >= (char *)bp && zero_lo < NEXT_BLKP(bp);
+
+    placed_zero_lo = zeroed ? zero_lo : NULL;
+    placed_zero_hi = zeroed ? zero_hi : NULL;
+
+    /* A remainder of fewer than SPLIT_MIN bytes stays in the block */
+    remove_from_list(bp);
+    if (nextsize >= SPLIT_MIN && asize > SMALL_LIMIT && GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0) {
+        /* Large blocks are carved from the top, leaving the remainder in
+         * place. Small and large blocks then tend to gather at opposite
+         * ends of free space. Not so in the last block: there, the block
+         * at the top would leave what the last growth step reserved
+         * ahead of demand below it, and the next growth could not make
+         * up for just what the last block lacks. */
+        PUT(HDRP(bp), PACK(nextsize, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(nextsize, 0));
+        add_to_list(bp);
+        if (zeroed && zero_hi > FTRP(bp))
+            zero_hi = FTRP(bp);  /* what is left of it is below the new footer */
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(asize, 1));
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
+        heap_stats.splits++;
+        return bp;
+    } else if (nextsize < SPLIT_MIN) {
+        PUT(HDRP(bp), GET(HDRP(bp)) | 1);
+        SET_PREV_ALLOC(NEXT_BLKP(bp)); // Successor now follows an allocated block
+    } else {
+        PUT(FTRP(bp), nextsize); // Update footer of free to have updated size after splitting
+        PUT(PADD(bp, asize - WSIZE), PACK(nextsize, PREV_ALLOC)); // Updating header of free block after splitting
+        add_to_list(PADD(bp, asize));
+        PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp)))); // Update header of bp
+        heap_stats.splits++;
+    }
+
+    /* The block was carved from the bottom: what is left of the range
+     * starts past it and the links of the remainder */
+    if (zeroed && zero_lo < PADD(NEXT_BLKP(bp), LINK_BYTES))
+        zero_lo = PADD(NEXT_BLKP(bp), LINK_BYTES);
+    return bp;
+}
+
+/*
+ * trim_block -- Shrink allocated block bp to asize bytes
+ * Takes a pointer to an allocated block and a block size no larger than it.
+ * If the tail beyond asize is big enough to be a block of its own, it is
+ * split off and freed (coalescing with a free successor); otherwise the
+ * block keeps its size.
+ * Returns nothing
+ */
+static void trim_block(void *bp, size_t asize) {
+    size_t tailsize = GET_SIZE(HDRP(bp)) - asize;
+
+    if (tailsize < SPLIT_MIN)
+        return;
+    heap_stats.splits++;
+    PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(tailsize, PREV_ALLOC));
+    CLEAR_PREV_ALLOC(NEXT_BLKP(NEXT_BLKP(bp)));
+    coalesce(NEXT_BLKP(bp));
+}
+
+/*
+ * coalesce -- Boundary tag coalescing. 
+ * Takes a pointer to a free block
+ * Return ptr to coalesced block
+ * bp must have its header and footer written, be on no free list, and the
+ * block after it must already have its previous-allocated bit clear. The
+ * block returned, merged with any free neighbors, is on its free list.
+ */
+static void *coalesce(void *bp) {
+    /*
+     * Check the previous-allocated bit in our header
+     * If clear, go to footer of previous block, take it off its list and
+     * grow the block backwards over it
+     * Go to header of block after input block
+     * If free, take it off its list and grow the block forwards over it
+     * Update the header and footer of the coalesced block, then put it on
+     * the list for its (possibly new) size class
+     */
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+        remove_from_list(NEXT_BLKP(bp));
+        CHECK_MERGE(NEXT_BLKP(bp), bp);
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        heap_stats.coalesces++;
+    }
+    if (!GET_PREV_ALLOC(HDRP(bp))) {
+        heap_stats.coalesces++;
+        remove_from_list(PREV_BLKP(bp));
+        CHECK_MERGE(bp, PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        bp = PREV_BLKP(bp);
+    }
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));
+    add_to_list(bp);
+    return bp;
+}
+
+/* 
+ * find_fit - Find a fit for a block with asize bytes 
+ */
+static void *find_fit(size_t asize) {
+    /* any block in an exact class at least that of asize fits */
+    for (int cls = size_class(asize); cls < NUM_SMALL; cls++) {
+        if (LIST_HEAD(cls) != NULL) {
+            heap_stats.walked++;
+            return LIST_HEAD(cls);
+        }
+    }
+
+    return tree_fit(asize);  /* NULL if no fit found */
+}
+
+/* 
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+static void *extend_heap(size_t words) {
+    char *bp, *fresh = mem_fresh_lo();
+    size_t size;
+    
+    /* Allocate an even number of words to maintain alignment */
+    size = words * WSIZE;
+    if (words % 2 == 1)
+        size += WSIZE;
+    if ((long)(bp = mem_sbrk(size)) < 0) 
+        return NULL;
+    heap_stats.extensions++;
+    trim_frees = 0;
+
+    /* Growing back over trimmed memory: trim only larger tails from now on */
+    if (trimmed > 0) {
+        trim_threshold = max(trim_threshold, 2 * trimmed);
+        trimmed = 0;
+    }
+
+    /* Initialize free block header/footer and the epilogue header */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* free block header --- replaces old epilogue */
+    PUT(FTRP(bp), PACK(size, 0));         /* free block footer  --- one block after b/c replaces epilogue*/
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header  --- in remaining block, follows a free block*/
+
+    /* The new space is zero from where memlib's fresh memory starts (past
+     * its links), up to its footer */
+    zero_lo = fresh > PADD(bp, LINK_BYTES) ? fresh : PADD(bp, LINK_BYTES);
+    zero_hi = FTRP(bp);
+
+    /* Coalesce if the previous block was free */
+    return coalesce(bp);
+}
+
+/*
+ * grow_size -- Returns the number of bytes to extend the heap by to place
+ * a block of asize bytes that fits in no free block, or to grow the block
+ * that ends the heap (or its free successor) by asize bytes
+ * If the last block of the heap is free, the extension just makes up for
+ * what it lacks, since the two coalesce. Otherwise the heap grows by asize
+ * or by 1/2^GROW_SHIFT of its size (at least CHUNKSIZE), whichever is
+ * larger. A growing heap thus takes geometrically larger steps, while
+ * what the last step reserves ahead of demand, still free when the heap
+ * peaks, stays a small fraction of it; a heap that was trimmed starts
+ * again with small steps.
+ * With MM_GROW_CHUNK, the step is always CHUNKSIZE.
+ */
+static size_t grow_size(size_t asize) {
+    char *end = PADD(mem_heap_hi(), 1); /* payload of the epilogue block */
+#if MM_GROWTH == MM_GROW_PROPORTIONAL
+    size_t step = (mem_heapsize() >> GROW_SHIFT) & ~(size_t)(DSIZE - 1);
+#else
+    size_t step = CHUNKSIZE;
+#endif
+
+    if (!GET_PREV_ALLOC(HDRP(end)))
+        return max(asize - GET_SIZE(PSUB(end, DSIZE)), MIN_BLOCK);
+    return max(asize, max(step, CHUNKSIZE));
+}
+
+/* 
+ * check_heap -- Performs basic heap consistency checks for an implicit free list allocator 
+ * and prints out all blocks in the heap in memory order. 
+ * Checks include proper prologue and epilogue, alignment, and matching header and footer
+ * Takes a line number (to give the output an identifying tag).
+ */
+static bool check_heap(int line) {
+    char *bp;
+    size_t nfree = 0;
+    int cls;
+
+    if ((GET_SIZE(HDRP(heap_start)) != DSIZE) || !GET_ALLOC(HDRP(heap_start))) {
+        printf("(check_heap at line %d) Error: bad prologue header\n", line);
+        return false;
+    }
+
+    for (bp = heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (!check_block(line, bp)) {
+            return false;
+        }
+        if (!GET_ALLOC(HDRP(bp)))
+            nfree++;
+        if (is_slab(bp) && (GET_SIZE(HDRP(bp)) != SLAB_BLOCK || (size_t)bp % SLAB_PAGE)) {
+            printf("(check_heap at line %d) Error: bad slab page %p\n", line, bp);
+            return false;
+        }
+        if (!GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))) != !GET_ALLOC(HDRP(bp))) {
+            printf("(check_heap at line %d) Error: %p has a stale previous-allocated bit\n", line, NEXT_BLKP(bp));
+            return false;
+        }
+    }
+    
+    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {
+        printf("(check_heap at line %d) Error: bad epilogue header\n", line);
+        return false;
+    }
+
+    for (cls = 0; cls < NUM_CLASSES; cls++)
+        nfree -= heap_stats.free_blocks[cls];
+    if (nfree != 0 ||
+        heap_stats.live_bytes + heap_stats.free_bytes + (LIST_WORDS + 3) * WSIZE 
+        != mem_heapsize()) {
+        printf("(check_heap at line %d) Error: stats disagree with the heap (%zu live, %zu free bytes in %zu)\n",
+               line, heap_stats.live_bytes, heap_stats.free_bytes, mem_heapsize());
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * check_block -- Checks a block for alignment and, if free, matching header and footer
+ */
+static bool check_block(int line, void *bp) {
+    if ((size_t)bp % DSIZE) {
+        printf("(check_heap at line %d) Error: %p is not double-word aligned\n", line, bp);
+        return false;
+    }
+    if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) != GET(FTRP(bp))) {
+        printf("(check_heap at line %d) Error: header does not match footer\n", line);
+        return false;
+    }
+    return true;
+}
+
+#if MM_CHECK
+/*
+ * check_op -- Checks the heap after an operation on block bp: bp and its
+ * neighbors in memory, then a slice of the whole heap (see check_step)
+ * Takes the line number of the operation and a block it left in place.
+ * Aborts if any check fails.
+ */
+static void check_op(int line, void *bp) {
+    void *prev;
+    bool ok = check_local(line, bp);
+
+    if (ok && GET_SIZE(HDRP(NEXT_BLKP(bp))) > 0)
+        ok = check_local(line, NEXT_BLKP(bp));
+    if (ok && !GET_PREV_ALLOC(HDRP(bp))) {
+        prev = PREV_BLKP(bp);
+        if (!in_heap(prev) || NEXT_BLKP(prev) != bp) {
+            printf("(check_op at line %d) Error: footer before %p does not lead to its predecessor\n", line, bp);
+            ok = false;
+        } else {
+            ok = check_local(line, prev);
+        }
+    }
+    if (ok)
+        ok = check_step(line);
+    if (!ok) {
+        print_block(bp);
+        fflush(stdout);
+        abort();
+    }
+}
+
+/*
+ * check_local -- Checks block bp in isolation and against its successor:
+ * size and alignment, the successor's previous-allocated bit, that no two
+ * free blocks are adjacent, and, for a free block, that its list (or the
+ * tree) holds it. A slab page must also agree with its bitmap.
+ */
+static bool check_local(int line, void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    void *next = NEXT_BLKP(bp);
+    slab_t *sp = bp;
+    unsigned w, used = 0;
+
+    if (!in_heap(bp) || size < MIN_BLOCK || size % DSIZE || !in_heap(HDRP(next))) {
+        printf("(check_op at line %d) Error: %p is not a block of the heap\n", line, bp);
+        return false;
+    }
+    if (!check_block(line, bp))
+        return false;
+    if (!GET_PREV_ALLOC(HDRP(next)) != !GET_ALLOC(HDRP(bp))) {
+        printf("(check_op at line %d) Error: %p has a stale previous-allocated bit\n", line, next);
+        return false;
+    }
+    if (GET_SIZE(HDRP(next)) == 0 && !GET_ALLOC(HDRP(next))) {
+        printf("(check_op at line %d) Error: bad epilogue header\n", line);
+        return false;
+    }
+
+    if (!GET_ALLOC(HDRP(bp))) {
+        if (!GET_ALLOC(HDRP(next)) || !GET_PREV_ALLOC(HDRP(bp))) {
+            printf("(check_op at line %d) Error: free block %p has a free neighbor\n", line, bp);
+            return false;
+        }
+        return check_links(line, bp);
+    }
+
+    if (is_slab(bp)) {
+        for (w = 0; w < SLAB_WORDS; w++)
+            used += __builtin_popcountl(sp->used[w]);
+        if (size != SLAB_BLOCK || (size_t)bp % SLAB_PAGE ||
+            sp->size < DSIZE || sp->size > SLAB_MAX || sp->size % DSIZE ||
+            sp->nslots != (SLAB_PAGE - SLAB_HDR) / sp->size ||
+            used != SLAB_WORDS * SLAB_BITS - sp->nfree) {
+            printf("(check_op at line %d) Error: bad slab page %p\n", line, bp);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * check_links -- Checks that free block bp is where a search for it would
+ * look: its list neighbors point back at it (or the head does), or, for a
+ * large block, the index search (or tree search) for it ends at it
+ */
+static bool check_links(int line, void *bp) {
+    int cls = size_class(GET_SIZE(HDRP(bp)));
+    void *next, *prev;
+
+    if (cls == NUM_SMALL) {
+        void *node;
+
+#if MM_LARGE_INDEX == MM_INDEX_ARRAY
+        if (!index_tree) {
+            size_t i = index_find(GET_SIZE(HDRP(bp)), bp);
+
+            if (i == index_count || index_blocks[i] != bp || index_sizes[i] != GET_SIZE(HDRP(bp))) {
+                printf("(check_op at line %d) Error: large free block %p is not in the index\n", line, bp);
+                return false;
+            }
+            return true;
+        }
+#endif
+
+        for (node = TREE_ROOT; node != bp; node = TREE_LESS(bp, node) ? TREE_LEFT(node) : TREE_RIGHT(node)) {
+            if (node == NULL || !in_heap(node) || GET_ALLOC(HDRP(node)) || GET_SIZE(HDRP(node)) <= SMALL_LIMIT) {
+                printf("(check_op at line %d) Error: large free block %p is not in the tree\n", line, bp);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    next = NEXT_FREE_BLKP(bp);
+    prev = PREV_FREE_BLKP(bp);
+    if ((prev == NULL ? LIST_HEAD(cls) != bp : !in_heap(prev) || NEXT_FREE_BLKP(prev) != bp) ||
+        (next != NULL && (!in_heap(next) || PREV_FREE_BLKP(next) != bp))) {
+        printf("(check_op at line %d) Error: free block %p is not linked into list %d\n", line, bp, cls);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * check_step -- Advances the heap walk and the free list walk, CHECK_BATCH
+ * blocks at a time, until MM_CHECK_BUDGET nanoseconds have passed
+ * The heap walk checks each block with check_local. The free list walk
+ * checks that each node is a free block of the class of its list.
+ */
+static bool check_step(int line) {
+    struct timespec ts;
+    long now, deadline;
+    void *bp;
+    int i, n;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    deadline = ts.tv_sec * 1000000000L + ts.tv_nsec + MM_CHECK_BUDGET;
+    do {
+        for (i = 0; i < CHECK_BATCH; i++) {
+            /* the next block in memory order */
+            bp = check_cursor != NULL ? check_cursor : NEXT_BLKP(heap_start);
+            if (GET_SIZE(HDRP(bp)) > 0) {
+                if (!check_local(line, bp))
+                    return false;
+                bp = NEXT_BLKP(bp);
+                check_cursor = GET_SIZE(HDRP(bp)) > 0 ? bp : NULL;
+            }
+
+            /* the next node of the current list, or the head of the next non-empty list */
+            bp = check_list_cursor;
+            for (n = 0; bp == NULL && n < NUM_SMALL; n++) {
+                check_list_cls = (check_list_cls + 1) % NUM_SMALL;
+                bp = LIST_HEAD(check_list_cls);
+            }
+            if (bp != NULL) {
+                if (!in_heap(bp) || GET_ALLOC(HDRP(bp)) || size_class(GET_SIZE(HDRP(bp))) != check_list_cls) {
+                    printf("(check_op at line %d) Error: list %d holds %p, which is not one of its free blocks\n",
+                           line, check_list_cls, bp);
+                    return false;
+                }
+                if (!check_links(line, bp))
+                    return false;
+                check_list_cursor = NEXT_FREE_BLKP(bp);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ts.tv_sec * 1000000000L + ts.tv_nsec;
+    } while (now < deadline);
+    return true;
+}
+
+/*
+ * in_heap -- Returns true if p points between the prologue and the end of the heap
+ */
+static bool in_heap(void *p) {
+    return (char *)p >= (char *)heap_start && (char *)p <= (char *)mem_heap_hi();
+}
+#endif
+
+/*
+ * print_heap -- Prints out the current state of the implicit free list
+ */
+static void print_heap() {
+    char *bp;
+
+    printf("Heap (%p):\n", heap_start);
+    printf("Free list heads at (%p)\n", (void *) free_lists);
+
+    for (bp = heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        print_block(bp);
+    }
+
+    print_block(bp);    
+}
+
+/*
+ * print_block -- Prints out the current state of a block
+ */
+static void print_block(void *bp) {
+    size_t hsize, halloc, fsize, falloc;
+
+    hsize = GET_SIZE(HDRP(bp));
+    halloc = GET_ALLOC(HDRP(bp));  
+    
+    if (hsize == 0) {
+        printf("%p: End of free list\n", bp);
+        return;
+    }
+
+    if (halloc) {
+        printf("%p: header: [%ld:%c:%c]\n", bp, 
+           hsize, (halloc ? 'a' : 'f'), (GET_PREV_ALLOC(HDRP(bp)) ? 'a' : 'f'));
+        return;
+    }
+
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));  
+    printf("%p: header: [%ld:%c:%c] footer: [%ld:%c] next: [%p] prev: [%p]\n", bp, 
+       hsize, (halloc ? 'a' : 'f'), (GET_PREV_ALLOC(HDRP(bp)) ? 'a' : 'f'),
+       fsize, (falloc ? 'a' : 'f'), 
        NEXT_FREE_BLKP(bp), PREV_FREE_BLKP(bp)); 
 }
 
+/*
+ * adjust_size -- Returns the block size needed for a payload of size bytes,
+ * including header overhead and rounded up to double-word alignment.
+ * Without a footer, a block is 16 bytes smaller only when size leaves 1 to
+ * 8 bytes over a multiple of 16; for a multiple of 16 itself, the word
+ * saved goes to the alignment padding, so the block is the same size.
+ */
+static size_t adjust_size(size_t size) {
+    if (size <= MIN_BLOCK - OVERHEAD)
+        return MIN_BLOCK;
+    /* Add overhead and then round up to nearest multiple of double-word alignment */
+    return DSIZE * ((size + (OVERHEAD) + (DSIZE - 1)) / DSIZE);
+}
+
+/*
+ * alloc_payload -- Allocate room for size bytes, as a slab slot if size is
+ * at most SLAB_MAX and its class has a page, else as a heap block
+ * Returns the payload pointer, or NULL if the heap cannot grow
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static void *alloc_payload(size_t size) {
+    void *bp;
+
+    REMOTE_DRAIN();
+    if (size <= SLAB_MAX && (bp = slab_alloc(SLAB_CLASS(size))) != NULL)
+        return bp;
+    return alloc_block(adjust_size(size));
+}
+
+/*
+ * free_payload -- Free a slab slot or heap block returned by alloc_payload
+ * With deferred coalescing, a small block goes on its quick list instead.
+ * With MM_THREADS, the caller must hold the heap lock.
+ */
+static void free_payload(void *bp) {
+    int cls;
+
+    if (is_slab(bp)) {
+        slab_free(bp);
+    } else if (defer_coalescing && GET_SIZE(HDRP(bp)) <= QUICK_MAX) {
+        cls = size_class(GET_SIZE(HDRP(bp)));
+        *(void **)bp = quick_lists[cls];
+        quick_lists[cls] = bp;
+        if (++quick_count > QUICK_LIMIT)
+            quick_flush();
+    } else {
+        free_block(bp);
+    }
+}
+
+/*
+ * is_slab -- Returns true if bp points into a slab page
+ * The map is accessed atomically since, with MM_THREADS, this runs without
+ * the lock. The bit for a page holding a live pointer cannot change.
+ */
+static bool is_slab(void *bp) {
+    size_t page = (size_t)bp / SLAB_PAGE - heap_first_page;
+
+    return (__atomic_load_n(&slab_map[page / 8], __ATOMIC_RELAXED) >> (page % 8)) & 1;
+}
+
+/*
+ * set_slab -- Sets or clears the slab_map bit of page sp
+ */
+static void set_slab(slab_t *sp, bool slab) {
+    size_t page = (size_t)sp / SLAB_PAGE - heap_first_page;
+
+    if (slab)
+        __atomic_or_fetch(&slab_map[page / 8], 1 << (page % 8), __ATOMIC_RELAXED);
+    else
+        __atomic_and_fetch(&slab_map[page / 8], ~(1 << (page % 8)), __ATOMIC_RELAXED);
+}
+
+/*
+ * slab_alloc -- Allocate a slot of slab class cls
+ * Takes the first free slot of the first page on the class list, starting
+ * a new page if the list is empty.
+ * Returns the slot, or NULL if the class is still warming up (see
+ * SLAB_WARMUP) or no page can be made
+ */
+static void *slab_alloc(int cls) {
+    slab_t *sp = slab_lists[cls];
+    unsigned w, bit;
+
+    if (sp == NULL) {
+        if (slab_demand[cls] < SLAB_WARMUP) {
+            slab_demand[cls]++;
+            return NULL;
+        }
+        if ((sp = slab_new_page(cls)) == NULL)
+            return NULL;
+    }
+
+    for (w = 0; ~sp->used[w] == 0; w++)
+        ;
+    bit = __builtin_ctzl(~sp->used[w]);
+    sp->used[w] |= (size_t)1 << bit;
+    heap_stats.slab_bytes += sp->size;
+    if (--sp->nfree == 0)
+        slab_unlink(sp);
+    CHECK_OP(sp);
+    return PADD(sp, SLAB_HDR + (w * SLAB_BITS + bit) * sp->size);
+}
+
+/*
+ * slab_free -- Return a slot to its page
+ * A page that was full goes back on its class list. A page that becomes
+ * empty is freed to the block heap, unless it is the only one on the list.
+ */
+static void slab_free(void *bp) {
+    slab_t *sp = SLAB_PAGEP(bp);
+    unsigned slot = (PSUB(bp, SLAB_HDR) - (char *)sp) / sp->size;
+
+    sp->used[slot / SLAB_BITS] &= ~((size_t)1 << (slot % SLAB_BITS));
+    heap_stats.slab_bytes -= sp->size;
+    if (sp->nfree++ == 0)
+        slab_link(sp);
+    if (sp->nfree == sp->nslots && (sp->next != NULL || sp->prev != NULL)) {
+        slab_unlink(sp);
+        set_slab(sp, false);
+        free_block(sp);
+        return;
+    }
+    CHECK_OP(sp);
+}
+
+/*
+ * slab_new_page -- Make an empty slab page for class cls and put it on the
+ * class list
+ * The page is an allocated block of SLAB_BLOCK bytes whose payload starts on
+ * a SLAB_PAGE boundary. It is carved from a free block if one can hold it
+ * (see slab_fit), the space below and above it staying free, and otherwise
+ * placed at the end of the heap, the space needed to reach the boundary
+ * becoming a free block (or joining the last block, if free).
+ * Returns the page, or NULL if the heap cannot grow
+ */
+static slab_t *slab_new_page(int cls) {
+    char *brk = PADD(mem_heap_hi(), 1); /* payload of a block placed at the end */
+    size_t gap, tail, prev_alloc;
+    char *bp, *next;
+    slab_t *sp;
+    unsigned slot;
+
+    if ((bp = slab_fit(&gap)) != NULL) {
+        /* Is the zero range in bp? Only what lies in the block above the
+         * page can stay in it */
+        bool zeroed = zero_lo < zero_hi && zero_lo >= bp && zero_lo < NEXT_BLKP(bp);
+
+        tail = GET_SIZE(HDRP(bp)) - gap - SLAB_BLOCK;
+        prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+        remove_from_list(bp);
+        sp = (slab_t *)PADD(bp, gap);
+        if (gap > 0) {
+            PUT(HDRP(bp), PACK(gap, prev_alloc));
+            PUT(FTRP(bp), PACK(gap, 0));
+            add_to_list(bp);
+            prev_alloc = 0;
+        }
+        PUT(HDRP(sp), PACK(SLAB_BLOCK, 1 | prev_alloc));
+        next = NEXT_BLKP(sp);
+        if (tail > 0) {
+            PUT(HDRP(next), PACK(tail, PREV_ALLOC));
+            PUT(FTRP(next), PACK(tail, 0));
+            add_to_list(next);
+            if (zeroed && zero_lo < PADD(next, LINK_BYTES))
+                zero_lo = PADD(next, LINK_BYTES);
+        } else {
+            SET_PREV_ALLOC(next);
+            if (zeroed)
+                zero_lo = zero_hi;
+        }
+    } else {
+        gap = (SLAB_PAGE - (size_t)brk % SLAB_PAGE) % SLAB_PAGE;
+        prev_alloc = GET_PREV_ALLOC(HDRP(brk)); /* from the old epilogue */
+        if (gap > 0 && gap < MIN_BLOCK)
+            gap += SLAB_PAGE;
+        if ((long)mem_sbrk(gap + SLAB_BLOCK) < 0)
+            return NULL;
+        heap_stats.extensions++;
+
+        sp = (slab_t *)PADD(brk, gap);
+        if (gap > 0) {
+            PUT(HDRP(brk), PACK(gap, prev_alloc));
+            PUT(FTRP(brk), PACK(gap, 0));
+            prev_alloc = 0;
+        }
+        PUT(HDRP(sp), PACK(SLAB_BLOCK, 1 | prev_alloc));
+        PUT(HDRP(NEXT_BLKP(sp)), PACK(0, 1 | PREV_ALLOC)); /* new epilogue header */
+        if (gap > 0)
+            coalesce(brk);
+    }
+    heap_stats.live_bytes += SLAB_BLOCK;
+
+    sp->size = (cls + 1) * DSIZE;
+    sp->nslots = (SLAB_PAGE - SLAB_HDR) / sp->size;
+    sp->nfree = sp->nslots;
+    memset(sp->used, 0, sizeof(sp->used));
+    for (slot = sp->nslots; slot < SLAB_WORDS * SLAB_BITS; slot++)
+        sp->used[slot / SLAB_BITS] |= (size_t)1 << (slot % SLAB_BITS);
+    slab_link(sp);
+    set_slab(sp, true);
+    return sp;
+}
+
+/*
+ * slab_fit -- Returns a free block that a slab page can be carved from,
+ * setting *gap to the bytes below the page, or NULL if there is none
+ * Both the gap and what is left above the page must be empty or hold a
+ * free block. The best fit for SLAB_BLOCK bytes is taken if the page fits
+ * it, and otherwise the best fit for a block that holds a page wherever
+ * it lies.
+ */
+static void *slab_fit(size_t *gap) {
+    size_t asize = SLAB_BLOCK, size, tail;
+    char *bp;
+
+    for (;;) {
+        if ((bp = find_fit(asize)) == NULL)
+            return NULL;
+        size = GET_SIZE(HDRP(bp));
+        *gap = (SLAB_PAGE - (size_t)bp % SLAB_PAGE) % SLAB_PAGE;
+        if (*gap > 0 && *gap < MIN_BLOCK)
+            *gap += SLAB_PAGE;
+        if (size >= *gap + SLAB_BLOCK &&
+            ((tail = size - *gap - SLAB_BLOCK) == 0 || tail >= MIN_BLOCK))
+            return bp;
+        if (asize > SLAB_BLOCK)
+            return NULL;
+        asize = SLAB_BLOCK + SLAB_PAGE + 2 * MIN_BLOCK;
+    }
+}
+
+/*
+ * slab_link -- Push page sp on the list of its class
+ */
+static void slab_link(slab_t *sp) {
+    int cls = SLAB_CLASS(sp->size);
+
+    sp->prev = NULL;
+    sp->next = slab_lists[cls];
+    if (sp->next != NULL)
+        sp->next->prev = sp;
+    slab_lists[cls] = sp;
+}
+
+/*
+ * slab_unlink -- Remove page sp from the list of its class
+ */
+static void slab_unlink(slab_t *sp) {
+    if (sp->prev == NULL)
+        slab_lists[SLAB_CLASS(sp->size)] = sp->next;
+    else
+        sp->prev->next = sp->next;
+    if (sp->next != NULL)
+        sp->next->prev = sp->prev;
+}
+
+#if MM_THREADS
+/*
+ * tcache_release -- pthread key destructor: returns an exiting thread's
+ * cached blocks to the shared heap
+ */
+static void tcache_release(void *arg) {
+    tcache_t *tc = arg;
+    int bin;
+
+    if (tc->generation != heap_generation)
+        return;
+    LOCK();
+    for (bin = 0; bin < TCACHE_BINS; bin++)
+        tcache_flush(tc, bin, tc->count[bin]);
+    UNLOCK();
+}
+
+/*
+ * tcache_init_key -- Creates the key whose destructor flushes thread caches
+ */
+static void tcache_init_key(void) {
+    pthread_key_create(&tcache_key, tcache_release);
+}
+
+/*
+ * get_tcache -- Returns the calling thread's cache, emptied if it still
+ * holds blocks from before the last mm_init
+ */
+static tcache_t *get_tcache(void) {
+    tcache_t *tc = &tcache;
+
+    if (tc->generation != heap_generation) {
+        if (tc->generation == 0) {
+            /* first use in this thread: arrange for the flush at exit */
+            pthread_once(&tcache_once, tcache_init_key);
+            pthread_setspecific(tcache_key, tc);
+        }
+        memset(tc->count, 0, sizeof(tc->count));
+        tc->generation = heap_generation;
+    }
+    return tc;
+}
+
+/*
+ * tcache_malloc -- Allocate room for size (<= TCACHE_MAX) bytes
+ * Pops a block (or slab slot) from the thread's bin for size. If the bin is
+ * empty, takes the heap lock once and refills it with up to TCACHE_BATCH
+ * blocks sized for the largest request of the bin.
+ * Returns the payload pointer, or NULL if the heap cannot grow
+ */
+static void *tcache_malloc(size_t size) {
+    tcache_t *tc = get_tcache();
+    int bin = TCACHE_BIN(size);
+    void *bp;
+
+    if (tc->count[bin] == 0) {
+        LOCK();
+        while (tc->count[bin] < TCACHE_BATCH) {
+            if ((bp = alloc_payload((bin + 1) * DSIZE)) == NULL)
+                break;
+            tc->blocks[bin][tc->count[bin]++] = bp;
+        }
+        UNLOCK();
+        if (tc->count[bin] == 0)
+            return NULL;
+    }
+    return tc->blocks[bin][--tc->count[bin]];
+}
+
+/*
+ * tcache_free -- Put allocated block (or slab slot) bp in the calling
+ * thread's cache
+ * If its bin is full, first takes the heap lock once and returns the
+ * TCACHE_BATCH oldest blocks of that bin to the heap.
+ * Returns false if the block is too large to be cached
+ */
+static bool tcache_free(void *bp) {
+    size_t asize;
+    tcache_t *tc;
+    int bin;
+
+    if (is_slab(bp)) {
+        bin = TCACHE_BIN(SLAB_PAGEP(bp)->size);
+    } else {
+        /* Read without the lock: a neighbor may flip our previous-allocated
+         * bit under the lock meanwhile, but the size bits of an allocated
+         * block only change at the hands of its owner. */
+        asize = GET_SHARED(HDRP(bp)) & ~0xf;
+        if (TCACHE_BLOCK_BIN(asize) >= TCACHE_BINS)
+            return false;
+        bin = TCACHE_BLOCK_BIN(asize);
+    }
+
+    tc = get_tcache();
+    if (tc->count[bin] == TCACHE_COUNT) {
+        if (TRYLOCK()) {
+            tcache_flush(tc, bin, TCACHE_BATCH);
+            UNLOCK();
+        } else {
+            /* The heap is busy: hand the batch over as one chain */
+            for (int i = 0; i < TCACHE_BATCH - 1; i++)
+                *(void **)tc->blocks[bin][i] = tc->blocks[bin][i + 1];
+            remote_push(tc->blocks[bin][0], tc->blocks[bin][TCACHE_BATCH - 1]);
+            memmove(tc->blocks[bin], tc->blocks[bin] + TCACHE_BATCH,
+                    (TCACHE_COUNT - TCACHE_BATCH) * sizeof(void *));
+            tc->count[bin] -= TCACHE_BATCH;
+        }
+    }
+    tc->blocks[bin][tc->count[bin]++] = bp;
+    return true;
+}
+
+/*
+ * tcache_flush -- Free the n oldest blocks of bin back to the heap
+ * The caller must hold the heap lock.
+ */
+static void tcache_flush(tcache_t *tc, int bin, int n) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        free_payload(tc->blocks[bin][i]);
+    memmove(tc->blocks[bin], tc->blocks[bin] + n,
+            (tc->count[bin] - n) * sizeof(void *));
+    tc->count[bin] -= n;
+}
+
+/*
+ * remote_push -- Push the chain of allocated blocks first..last (linked
+ * through their first payload words) on remote_frees, without the lock
+ */
+static void remote_push(void *first, void *last) {
+    void *head = __atomic_load_n(&remote_frees, __ATOMIC_RELAXED);
+
+    do
+        *(void **)last = head;
+    while (!__atomic_compare_exchange_n(&remote_frees, &head, first, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_drain -- Take every block on remote_frees and free it
+ * The caller must hold the heap lock. Since the stack is taken whole, and
+ * only ever by the lock holder, pops cannot race with each other.
+ */
+static void remote_drain(void) {
+    void *bp = __atomic_exchange_n(&remote_frees, NULL, __ATOMIC_ACQUIRE);
+    void *next;
+
+    for (; bp != NULL; bp = next) {
+        next = *(void **)bp;
+        free_payload(bp);
+        heap_stats.remote_frees++;
+    }
+}
+#endif
+
+/*
+ * compare_ptrs -- qsort comparison of two pointers by address
+ */
+static int compare_ptrs(const void *a, const void *b) {
+    char *x = *(char * const *)a, *y = *(char * const *)b;
+
+    return (x > y) - (x < y);
+}
+
 /*
  * max: returns x if x > y, and y otherwise.
  */
 static size_t max(size_t x, size_t y) {
     return (x > y) ? x : y;
 }
+
+/*
+ * min: returns x if x < y, and y otherwise.
+ */
+static size_t min(size_t x, size_t y) {
+    return (x < y) ? x : y;
+}
@@ -5,6 +5,94 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * Allocate zeroed memory for an array of nmemb elements of size bytes,
+ * like calloc. Memory the heap has just grown over is not cleared again.
+ */
+extern void *mm_calloc(size_t nmemb, size_t size);
+
+/*
+ * Allocate size bytes aligned to align bytes, which mm_memalign rounds up
+ * to a power of two and mm_aligned_alloc requires to be one. The result
+ * can be passed to mm_free and mm_realloc.
+ */
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+
+/*
+ * Allocate n blocks of size bytes each into ptrs[0..n-1], all carved from
+ * one free block. Returns n, or 0 (allocating nothing) if the heap cannot
+ * grow. The blocks are freed with mm_free or mm_free_batch.
+ */
+extern size_t mm_malloc_batch(size_t size, void **ptrs, size_t n);
+
+/* Free the n blocks in ptrs (NULL entries are skipped); sorts ptrs in place */
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/*
+ * Arenas hand out memory from large heap blocks by bumping a pointer, and
+ * give it all back at once: mm_arena_reset frees everything allocated in
+ * the arena, and mm_arena_destroy also frees the arena itself. Memory from
+ * an arena must not be passed to mm_free or mm_realloc, and an arena must
+ * not be used by two threads at once.
+ */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(void);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/* Number of free block size classes reported by mm_stats */
+#define MM_NUM_CLASSES 16
+
+/*
+ * Counters describing the heap of the mm package, kept up to date as it
+ * runs. Every byte of the heap is in an allocated block (live_bytes), in
+ * a free block (free_bytes), or in the fixed prologue/epilogue overhead.
+ */
+typedef struct {
+    size_t live_bytes;    /* bytes in allocated blocks, including slab pages */
+    size_t free_bytes;    /* bytes in free blocks */
+    size_t slab_bytes;    /* bytes of the slots in use in slab pages */
+    size_t free_blocks[MM_NUM_CLASSES]; /* free blocks in each size class */
+    unsigned long walked;     /* free blocks examined by fit searches */
+    unsigned long splits;     /* blocks split to place or shrink a block */
+    unsigned long coalesces;  /* free neighbors merged into freed blocks */
+    unsigned long extensions; /* times the heap was grown */
+    unsigned long reallocs;   /* blocks resized by mm_realloc (slab slots aside) */
+    unsigned long realloc_moves; /* of those, blocks it had to move and copy */
+    unsigned long remote_frees; /* frees left for the lock holder (MM_THREADS) */
+} mm_stats_t;
+
+/* Copy the current counters into *stats */
+extern void mm_stats(mm_stats_t *stats);
+
+/*
+ * Call visit(bp, size, alloc, arg) on every block of the heap in address
+ * order, where bp is the block's payload, size the size of the whole
+ * block in bytes and alloc 1 if it is allocated. The heap is locked
+ * meanwhile, so visit must not call the mm package.
+ */
+typedef void (*mm_visit_t)(void *bp, size_t size, int alloc, void *arg);
+
+extern void mm_heap_walk(mm_visit_t visit, void *arg);
+
+/*
+ * Choose between coalescing freed blocks at once (defer = 0, the default)
+ * and holding small freed blocks on quick lists, to be coalesced in
+ * batches (defer = 1). Switching off coalesces any blocks still held.
+ */
+extern void mm_defer_coalescing(int defer);
+
+/*
+ * Choose whether mm_realloc leaves headroom in blocks it has resized
+ * MM_REALLOC_HOT times before (room = 1, the default), so that they can
+ * keep growing in place, or sizes every block to the request (room = 0).
+ * mm.c built with MM_ROOM_NONE never leaves headroom.
+ */
+extern void mm_realloc_headroom(int room);
+
 
 /* 
  * You can work in teams of one or two. Enter your team name, 
@@ -0,0 +1,361 @@
+/*
+ * mmrecord.c - an LD_PRELOAD interposer that logs the allocation calls
+ *     of a program, in the per-thread format of mmrecord.h
+ *
+ * usage: LD_PRELOAD=./mmrecord.so [MMRECORD_DIR=<dir>] <program> ...
+ *
+ * Each call is passed on to the next definition of the function (libc's),
+ * found with dlsym(RTLD_NEXT). Since dlsym may allocate, requests made
+ * before the real functions are known get memory from a static buffer.
+ * The records of a thread are gathered in a buffer obtained with mmap, so
+ * that the recorder never allocates with malloc itself, and written out
+ * with write(2) when the buffer fills, when the thread exits, and when
+ * the program exits. Records of threads still running at exit may be lost.
+ *
+ * A free is numbered before it is passed on, and an allocation after it
+ * returns, so that a block reused by another thread is freed before it is
+ * handed out again in the merged order. A realloc is both, so it takes a
+ * number before it is passed on and another one once it returns.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "mmrecord.h"
+
+#define REC_BUF    4096         /* records buffered per thread */
+#define BOOT_SIZE  (64 * 1024)  /* bytes for allocations made while looking up libc */
+
+/* The log of one thread */
+typedef struct log {
+    int fd;              /* open log file, or -1 before its first write */
+    int n;               /* records in buf */
+    struct log *next;    /* next log of the process */
+    rec_t buf[REC_BUF];
+} log_t;
+
+/* The functions the calls are passed on to */
+static void *(*real_malloc)(size_t size);
+static void *(*real_calloc)(size_t nmemb, size_t size);
+static void *(*real_realloc)(void *ptr, size_t size);
+static void (*real_free)(void *ptr);
+static void *(*real_memalign)(size_t align, size_t size);
+static void *(*real_aligned_alloc)(size_t align, size_t size);
+static int (*real_posix_memalign)(void **memptr, size_t align, size_t size);
+
+/* Memory handed out while dlsym runs */
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+static int looking_up;
+
+/* All logs, the shared record counter, and whether recording stopped at exit */
+static log_t *all_logs;
+static pthread_mutex_t logs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t log_key;
+static uint64_t next_seq;
+static int stopped;
+
+static __thread log_t *my_log;
+static __thread int in_recorder;  /* set while the recorder runs, or after the thread's log closed */
+
+static void flush_log(log_t *log);
+static void record_at(uint32_t type, void *ptr, void *old, size_t size, size_t align,
+                      uint64_t seq, uint64_t done);
+
+/*
+ * lookup - Find the real allocation functions
+ */
+static void lookup(void)
+{
+    looking_up = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    looking_up = 0;
+}
+
+/*
+ * boot_alloc - Bump allocate from boot_buf, for calls made by dlsym
+ */
+static void *boot_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (size > BOOT_SIZE - boot_used)
+        return NULL;
+    p = boot_buf + boot_used;
+    boot_used += size;
+    return p;
+}
+
+/* Returns true if p came from boot_alloc */
+#define IS_BOOT(p)  ((char *)(p) >= boot_buf && (char *)(p) < boot_buf + BOOT_SIZE)
+
+/*
+ * close_log - pthread key destructor: write out an exiting thread's
+ *     records and release its log
+ */
+static void close_log(void *arg)
+{
+    log_t *log = arg, **lp;
+
+    in_recorder = 1;  /* this thread records no more */
+    pthread_mutex_lock(&logs_lock);
+    for (lp = &all_logs; *lp != log; lp = &(*lp)->next)
+        ;
+    *lp = log->next;
+    pthread_mutex_unlock(&logs_lock);
+
+    flush_log(log);
+    if (log->fd >= 0)
+        close(log->fd);
+    munmap(log, sizeof(log_t));
+}
+
+/*
+ * reset_logs - fork handler: the child starts logs of its own, leaving
+ *     the records buffered so far to the parent
+ */
+static void reset_logs(void)
+{
+    log_t *log;
+
+    for (log = all_logs; log != NULL; log = log->next) {
+        log->n = 0;
+        if (log->fd >= 0)
+            close(log->fd);
+        log->fd = -1;
+    }
+}
+
+/*
+ * new_log - Make the calling thread's log
+ *     Returns it, or NULL if no memory could be mapped for it
+ */
+static log_t *new_log(void)
+{
+    log_t *log = mmap(NULL, sizeof(log_t), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (log == MAP_FAILED)
+        return NULL;
+    log->fd = -1;
+    log->n = 0;
+    pthread_mutex_lock(&logs_lock);
+    log->next = all_logs;
+    all_logs = log;
+    pthread_mutex_unlock(&logs_lock);
+    pthread_setspecific(log_key, log);
+    return log;
+}
+
+/*
+ * flush_log - Write the buffered records of log to its file, creating
+ *     the file on the first write
+ */
+static void flush_log(log_t *log)
+{
+    char path[4096];
+    const char *dir;
+    size_t len = log->n * sizeof(rec_t);
+    char *p = (char *)log->buf;
+    ssize_t w;
+
+    if (log->n == 0)
+        return;
+    if (log->fd < 0) {
+        if ((dir = getenv("MMRECORD_DIR")) == NULL)
+            dir = ".";
+        snprintf(path, sizeof(path), "%s/mmrec.%d.%ld", dir, (int)getpid(),
+                 (long)syscall(SYS_gettid));
+        if ((log->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+            write(log->fd, REC_MAGIC, sizeof(REC_MAGIC)) != sizeof(REC_MAGIC)) {
+            log->n = 0;  /* nowhere to put them */
+            return;
+        }
+    }
+    while (len > 0 && (w = write(log->fd, p, len)) > 0) {
+        p += w;
+        len -= w;
+    }
+    log->n = 0;
+}
+
+/*
+ * take_seq - Returns the next number of the counter shared by all threads
+ */
+static uint64_t take_seq(void)
+{
+    return __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * record - Log a call of the given type, numbered now
+ */
+static void record(uint32_t type, void *ptr, void *old, size_t size, size_t align)
+{
+    uint64_t seq = take_seq();
+
+    record_at(type, ptr, old, size, align, seq, seq);
+}
+
+/*
+ * record_at - Log a call of the given type with the numbers seq and done
+ *     (see rec_t)
+ */
+static void record_at(uint32_t type, void *ptr, void *old, size_t size, size_t align,
+                      uint64_t seq, uint64_t done)
+{
+    log_t *log;
+    rec_t *r;
+
+    if (in_recorder || __atomic_load_n(&stopped, __ATOMIC_RELAXED))
+        return;
+    in_recorder = 1;
+    if ((log = my_log) == NULL)
+        log = my_log = new_log();
+    if (log != NULL) {
+        r = &log->buf[log->n++];
+        r->seq = seq;
+        r->done = done;
+        r->ptr = (uint64_t)ptr;
+        r->old = (uint64_t)old;
+        r->size = size;
+        r->type = type;
+        r->align = align;
+        if (log->n == REC_BUF)
+            flush_log(log);
+    }
+    in_recorder = 0;
+}
+
+/*
+ * start, stop - Set up before main, and write out all logs at exit
+ */
+__attribute__((constructor)) static void start(void)
+{
+    if (real_malloc == NULL)
+        lookup();
+    pthread_key_create(&log_key, close_log);
+    pthread_atfork(NULL, NULL, reset_logs);
+}
+
+__attribute__((destructor)) static void stop(void)
+{
+    log_t *log;
+
+    __atomic_store_n(&stopped, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&logs_lock);
+    for (log = all_logs; log != NULL; log = log->next)
+        flush_log(log);
+    pthread_mutex_unlock(&logs_lock);
+}
+
+/*
+ * The interposed functions
+ */
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+        if (looking_up)
+            return boot_alloc(size);
+        lookup();
+    }
+    p = real_malloc(size);
+    record(REC_MALLOC, p, NULL, size, 0);
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+        if (looking_up)
+            return (size == 0 || nmemb <= BOOT_SIZE / size) ? boot_alloc(nmemb * size) : NULL;
+        lookup();
+    }
+    p = real_calloc(nmemb, size);
+    record(REC_CALLOC, p, NULL, nmemb * size, 0);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    uint64_t seq, done;
+    void *p;
+
+    if (real_realloc == NULL)
+        lookup();
+    if (IS_BOOT(ptr)) {
+        /* never freed, and its size is unknown: copy what there can be */
+        if ((p = malloc(size)) != NULL)
+            memcpy(p, ptr, size < (size_t)(boot_buf + boot_used - (char *)ptr) ?
+                   size : (size_t)(boot_buf + boot_used - (char *)ptr));
+        return p;
+    }
+    /* Others may reuse ptr during the call, but p is not ours until it
+     * returns */
+    seq = take_seq();
+    p = real_realloc(ptr, size);
+    done = take_seq();
+    record_at(REC_REALLOC, p, ptr, size, 0, ptr == NULL ? done : seq, done);
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || IS_BOOT(ptr))
+        return;
+    if (real_free == NULL)
+        lookup();
+    record(REC_FREE, ptr, NULL, 0, 0);
+    real_free(ptr);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+        lookup();
+    p = real_memalign(align, size);
+    record(REC_MEMALIGN, p, NULL, size, align);
+    return p;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+        lookup();
+    p = real_aligned_alloc(align, size);
+    record(REC_MEMALIGN, p, NULL, size, align);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    int err;
+
+    if (real_posix_memalign == NULL)
+        lookup();
+    if ((err = real_posix_memalign(memptr, align, size)) == 0)
+        record(REC_MEMALIGN, *memptr, NULL, size, align);
+    return err;
+}
@@ -0,0 +1,37 @@
+/*
+ * mmrecord.h - the per-thread logs written by the mmrecord.so interposer
+ *
+ * Run a program with LD_PRELOAD=./mmrecord.so to log every call it makes
+ * to malloc, calloc, realloc, free and the aligned allocators. Each thread
+ * writes its own file, MMRECORD_DIR/mmrec.<pid>.<tid> (MMRECORD_DIR
+ * defaults to the current directory), made of REC_MAGIC and then packed
+ * rec_t records in host byte order. Every record carries a number from a
+ * counter shared by all threads, so rec2trace can merge the files back
+ * into the order the calls happened in, and turn them into a trace. A
+ * realloc carries two: seq, taken before the call, when the old block is
+ * given up, and done, taken once it returned, when a block that moved
+ * took its new address.
+ */
+#ifndef __MMRECORD_H_
+#define __MMRECORD_H_
+
+#include <stdint.h>
+
+/* First bytes of a log */
+#define REC_MAGIC  "MMREC02"   /* 8 bytes with the terminating NUL */
+
+/* Types of calls */
+enum {REC_MALLOC, REC_CALLOC, REC_REALLOC, REC_FREE, REC_MEMALIGN};
+
+/* One call */
+typedef struct {
+    uint64_t seq;    /* position of the call among those of all threads */
+    uint64_t done;   /* REC_REALLOC: position of its return (else seq) */
+    uint64_t ptr;    /* pointer returned, or passed to free */
+    uint64_t old;    /* pointer passed to realloc */
+    uint64_t size;   /* bytes requested (calloc: count times size) */
+    uint32_t type;   /* REC_MALLOC, ... */
+    uint32_t align;  /* alignment requested, for REC_MEMALIGN */
+} rec_t;
+
+#endif /* __MMRECORD_H_ */
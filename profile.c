@@ -0,0 +1,191 @@
+/*
+ * profile.c - latency histograms and hardware event counters used by
+ *     the profiling mode (-P) of mdriver
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "profile.h"
+
+/* Number of linear sub-buckets per power of two */
+#define HIST_SUB (1 << HIST_SUB_BITS)
+
+/* 
+ * hist_bucket - Return the bucket for value. Values below HIST_SUB
+ *     get a bucket each; above that, a value whose top bit is bit e 
+ *     goes in sub-bucket (next HIST_SUB_BITS bits) of power e.
+ */
+static int hist_bucket(unsigned long value)
+{
+    int e;
+
+    if (value < HIST_SUB)
+        return value;
+    e = 63 - __builtin_clzl(value);
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) |
+        ((value >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* 
+ * hist_bucket_top - Return the largest value in bucket b, the inverse 
+ *     of hist_bucket
+ */
+static unsigned long hist_bucket_top(int b)
+{
+    int e = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    unsigned long sub = b & (HIST_SUB - 1);
+
+    if (b < HIST_SUB)
+        return b;
+    return ((HIST_SUB | sub) << (e - HIST_SUB_BITS)) + 
+        (1UL << (e - HIST_SUB_BITS)) - 1;
+}
+
+void hist_add(hist_t *hist, unsigned long value)
+{
+    hist->buckets[hist_bucket(value)]++;
+    hist->count++;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+unsigned long hist_percentile(const hist_t *hist, double pct)
+{
+    unsigned long rank, seen = 0;
+    unsigned long top;
+    int b;
+
+    if (hist->count == 0)
+        return 0;
+
+    /* the rank-th smallest sample, counting from 1 */
+    rank = (unsigned long)(pct / 100.0 * hist->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank)
+            break;
+    }
+    top = hist_bucket_top(b);
+    return (top < hist->max) ? top : hist->max;
+}
+
+unsigned long prof_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+unsigned long prof_overhead(void)
+{
+    unsigned long best = (unsigned long)-1;
+    unsigned long start, end;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        start = prof_now();
+        end = prof_now();
+        if (end - start < best)
+            best = end - start;
+    }
+    return best;
+}
+
+const char *counter_names[NUM_COUNTERS] = {
+    "cycles", "cache-misses", "dTLB-misses"
+};
+
+#ifdef __linux__
+/* The perf event type and config of each counter */
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} counter_events[NUM_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+#endif
+
+int counters_open(counters_t *counters)
+{
+    int i, n = 0;
+
+    counters->error = ENOSYS;
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        counters->fd[i] = -1;
+#ifdef __linux__
+        {
+            struct perf_event_attr attr;
+
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = counter_events[i].type;
+            attr.config = counter_events[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            counters->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (counters->fd[i] < 0 && n == i)
+                counters->error = errno;
+        }
+#endif
+        if (counters->fd[i] >= 0)
+            n++;
+    }
+    return n;
+}
+
+void counters_start(counters_t *counters)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        if (counters->fd[i] >= 0) {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void counters_stop(counters_t *counters, long long values[NUM_COUNTERS])
+{
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        values[i] = -1;
+#ifdef __linux__
+        if (counters->fd[i] >= 0) {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counters->fd[i], &values[i], sizeof(values[i])) != 
+                sizeof(values[i]))
+                values[i] = -1;
+        }
+#endif
+    }
+}
+
+void counters_close(counters_t *counters)
+{
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        if (counters->fd[i] >= 0)
+            close(counters->fd[i]);
+        counters->fd[i] = -1;
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * profile.h - latency histograms and hardware event counters used by
+ *     the profiling mode (-P) of mdriver
+ */
+#ifndef __PROFILE_H_
+#define __PROFILE_H_
+
+/*
+ * A latency histogram has one bucket per power of two, each split into
+ * 2^HIST_SUB_BITS linear sub-buckets, so that percentiles are within
+ * 25% of the true value at every scale.
+ */
+#define HIST_SUB_BITS 2
+#define HIST_BUCKETS  (64 << HIST_SUB_BITS)
+
+typedef struct {
+    unsigned long count;                 /* number of samples */
+    unsigned long max;                   /* largest sample */
+    unsigned long buckets[HIST_BUCKETS]; /* number of samples per bucket */
+} hist_t;
+
+/* Add a sample (e.g., a latency in ns) to a histogram */
+void hist_add(hist_t *hist, unsigned long value);
+
+/* 
+ * hist_percentile - Return an upper bound on the pct percentile
+ *     (0 < pct <= 100) of the samples: the top of the bucket that holds
+ *     it, capped by the largest sample. Returns 0 if there are none.
+ */
+unsigned long hist_percentile(const hist_t *hist, double pct);
+
+/* Read a monotonic clock, in nanoseconds */
+unsigned long prof_now(void);
+
+/* 
+ * prof_overhead - Return the cost in ns of the prof_now calls around
+ *     a timed call (the smallest seen in a number of tries)
+ */
+unsigned long prof_overhead(void);
+
+/*
+ * Hardware event counters, read with perf_event_open where the kernel
+ * allows it. A counter that cannot be opened reads as -1.
+ */
+#define NUM_COUNTERS 3
+
+typedef struct {
+    int fd[NUM_COUNTERS];   /* perf event descriptors, or -1 */
+    int error;              /* errno from the first one that failed to open */
+} counters_t;
+
+/* The names of the counted events */
+extern const char *counter_names[NUM_COUNTERS];
+
+/* Open the counters; return how many are available */
+int counters_open(counters_t *counters);
+
+/* Reset and start the available counters */
+void counters_start(counters_t *counters);
+
+/* Stop the counters and store their values (-1 if unavailable) */
+void counters_stop(counters_t *counters, long long values[NUM_COUNTERS]);
+
+/* Close the counters */
+void counters_close(counters_t *counters);
+
+#endif /* __PROFILE_H_ */
@@ -0,0 +1,401 @@
+/*
+ * rec2trace.c - turn the logs written by mmrecord.so into a trace that
+ *     mdriver can replay
+ *
+ * usage: rec2trace [-b] <out> <log>...
+ *
+ * The records of all logs (normally those of one process, mmrec.<pid>.*)
+ * are merged in the order of their sequence numbers. Each block gets an
+ * id when it is allocated, and keeps it through reallocs until it is
+ * freed; the ids of freed blocks are then reused, so that the trace has
+ * about as many ids as the program had live blocks at its peak. A realloc
+ * that moved its block gives up the old address at its first number, and
+ * only takes the new one at its second (see rec_t), so a thread that
+ * reused the old address, or freed the new one, in the meantime is merged
+ * in between. Frees of blocks allocated before recording started are
+ * dropped, and so are requests an int cannot hold. A block handed out
+ * while its address was still live can then only be due to a free whose
+ * record was lost (see mmrecord.c), and is taken to have been freed just
+ * before. The trace is written in the text format, or with -b in the
+ * binary format of tracefmt.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "tracefmt.h"
+#include "mmrecord.h"
+
+/* Type of the record added for each realloc that moved its block: the new
+ * address, at the realloc's done number, with the block's id as size
+ * (NO_ID until the realloc is converted, and after it is dropped) */
+#define REC_PLACED  0x100
+#define NO_ID       UINT64_MAX
+
+/* Open addressing hash table from live block addresses to their ids */
+typedef struct {
+    uint64_t ptr;   /* block address, 0 for an empty slot, 1 for a deleted one */
+    int id;
+} slot_t;
+
+static slot_t *table;
+static size_t table_size;  /* a power of two */
+static size_t table_used;  /* slots not empty (including deleted ones) */
+static size_t table_live;  /* slots holding a live block */
+
+/* The trace being built */
+static traceop_t *ops;
+static int num_ops, max_ops;
+static int num_ids;
+static size_t *id_sizes, live, peak;  /* size of each live id, and their total */
+static int *free_ids;                 /* ids that can be used again */
+static int num_free_ids, max_ids;
+static long dropped;
+
+/* The records, in order */
+static rec_t *recs;
+static size_t nrecs;
+
+/*
+ * hash - Mix the bits of a block address
+ */
+static size_t hash(uint64_t ptr)
+{
+    ptr ^= ptr >> 33;
+    ptr *= 0xff51afd7ed558ccdULL;
+    ptr ^= ptr >> 33;
+    return ptr & (table_size - 1);
+}
+
+/*
+ * find - Returns the slot holding ptr, or the empty slot at the end of
+ *     its probe sequence
+ */
+static slot_t *find(uint64_t ptr)
+{
+    size_t i;
+
+    for (i = hash(ptr); table[i].ptr != 0; i = (i + 1) & (table_size - 1))
+        if (table[i].ptr == ptr)
+            return &table[i];
+    return &table[i];
+}
+
+/*
+ * insert - Map ptr, which is not in the table, to id
+ *     Once half the slots are used, the table is rehashed: at the same
+ *     size if deleted slots make up most of them, so that its size
+ *     follows the live blocks and not all the blocks ever allocated,
+ *     and at twice the size otherwise.
+ */
+static void insert(uint64_t ptr, int id)
+{
+    slot_t *old = table, *s;
+    size_t i, old_size = table_size;
+
+    if (2 * (table_used + 1) > table_size) {
+        if (4 * (table_live + 1) > old_size)
+            table_size = 2 * old_size;
+        if ((table = calloc(table_size, sizeof(slot_t))) == NULL) {
+            fprintf(stderr, "rec2trace: out of memory\n");
+            exit(1);
+        }
+        table_used = 0;
+        for (i = 0; i < old_size; i++) {
+            if (old[i].ptr > 1) {
+                *find(old[i].ptr) = old[i];
+                table_used++;
+            }
+        }
+        free(old);
+    }
+    s = find(ptr);
+    s->ptr = ptr;
+    s->id = id;
+    table_used++;
+    table_live++;
+}
+
+/*
+ * unmap - Delete the mapping in slot s
+ */
+static void unmap(slot_t *s)
+{
+    s->ptr = 1;
+    table_live--;
+}
+
+/*
+ * emit - Append an op to the trace, keeping track of the live bytes
+ */
+static void emit(int type, int id, size_t size, int align)
+{
+    if (num_ops == max_ops) {
+        max_ops = max_ops ? 2 * max_ops : 4096;
+        if ((ops = realloc(ops, max_ops * sizeof(traceop_t))) == NULL) {
+            fprintf(stderr, "rec2trace: out of memory\n");
+            exit(1);
+        }
+    }
+    ops[num_ops].type = type;
+    ops[num_ops].index = id;
+    ops[num_ops].size = type == FREE ? 0 : (int)size;
+    ops[num_ops].align = align;
+    num_ops++;
+
+    live -= id_sizes[id];
+    id_sizes[id] = type == FREE ? 0 : size;
+    live += id_sizes[id];
+    if (live > peak)
+        peak = live;
+}
+
+/*
+ * new_id - Returns an id that is not live: a freed one, or a fresh one
+ */
+static int new_id(void)
+{
+    if (num_free_ids > 0)
+        return free_ids[--num_free_ids];
+    if (num_ids == max_ids) {
+        max_ids = max_ids ? 2 * max_ids : 4096;
+        if ((id_sizes = realloc(id_sizes, max_ids * sizeof(size_t))) == NULL ||
+            (free_ids = realloc(free_ids, max_ids * sizeof(int))) == NULL) {
+            fprintf(stderr, "rec2trace: out of memory\n");
+            exit(1);
+        }
+    }
+    id_sizes[num_ids] = 0;
+    return num_ids++;
+}
+
+/*
+ * release - Free the block at ptr, if it is live
+ */
+static void release(uint64_t ptr)
+{
+    slot_t *s = find(ptr);
+
+    if (s->ptr == 0) {
+        dropped++;
+        return;
+    }
+    emit(FREE, s->id, 0, 0);
+    free_ids[num_free_ids++] = s->id;
+    unmap(s);
+}
+
+/*
+ * place - Map ptr, which was just handed out, to id
+ */
+static void place(uint64_t ptr, int id)
+{
+    if (find(ptr)->ptr != 0)
+        release(ptr);
+    insert(ptr, id);
+}
+
+/*
+ * allocate - A block of size bytes was handed out at ptr by a request
+ *     of the given type (ALLOC or CALLOC)
+ */
+static void allocate(int type, uint64_t ptr, uint64_t size, uint32_t align)
+{
+    int id = new_id();
+
+    place(ptr, id);
+    emit(type, id, size == 0 ? 1 : size, align > 16 ? (int)align : 0);
+}
+
+/*
+ * moved - Returns the REC_PLACED record of realloc record r
+ */
+static rec_t *moved(const rec_t *r)
+{
+    size_t lo = 0, hi = nrecs, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (recs[mid].seq < r->done)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return &recs[lo];
+}
+
+/*
+ * convert - Turn one record into trace ops
+ */
+static void convert(const rec_t *r)
+{
+    slot_t *s;
+    int id;
+
+    if (r->type == REC_PLACED) {
+        if (r->size != NO_ID)
+            place(r->ptr, r->size);
+        return;
+    }
+    if (r->size > INT_MAX || r->align > INT_MAX) {
+        dropped++;
+        return;
+    }
+    switch (r->type) {
+    case REC_MALLOC:
+    case REC_MEMALIGN:
+        if (r->ptr != 0)
+            allocate(ALLOC, r->ptr, r->size, r->align);
+        break;
+
+    case REC_CALLOC:
+        if (r->ptr != 0)
+            allocate(CALLOC, r->ptr, r->size, 0);
+        break;
+
+    case REC_REALLOC:
+        if (r->old == 0) {                 /* realloc(NULL, size) */
+            if (r->ptr != 0)
+                allocate(ALLOC, r->ptr, r->size, 0);
+        } else if (r->ptr == 0) {          /* failed, or realloc(ptr, 0) */
+            if (r->size == 0)
+                release(r->old);
+        } else if ((s = find(r->old))->ptr == 0) {
+            dropped++;                     /* block from before recording */
+            id = new_id();
+            if (r->ptr == r->old)
+                place(r->ptr, id);
+            else
+                moved(r)->size = id;
+            emit(ALLOC, id, r->size == 0 ? 1 : r->size, 0);
+        } else {
+            id = s->id;
+            if (r->ptr != r->old) {
+                unmap(s);
+                moved(r)->size = id;
+            }
+            emit(REALLOC, id, r->size == 0 ? 1 : r->size, 0);
+        }
+        break;
+
+    case REC_FREE:
+        release(r->ptr);
+        break;
+
+    default:
+        dropped++;
+    }
+}
+
+/*
+ * compare_seq - qsort comparison of records by sequence number
+ */
+static int compare_seq(const void *a, const void *b)
+{
+    uint64_t x = ((const rec_t *)a)->seq, y = ((const rec_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    int binary = 0, c, i;
+    size_t maxrecs = 0, n, nread;
+    char magic[sizeof(REC_MAGIC)];
+    trace_hdr_t hdr;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "b")) != EOF) {
+        if (c != 'b')
+            break;
+        binary = 1;
+    }
+    if (c != EOF || argc - optind < 2) {
+        fprintf(stderr, "usage: %s [-b] <out> <log>...\n", argv[0]);
+        exit(1);
+    }
+
+    /* Read all records */
+    for (i = optind + 1; i < argc; i++) {
+        if ((fp = fopen(argv[i], "rb")) == NULL) {
+            perror(argv[i]);
+            exit(1);
+        }
+        if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+            memcmp(magic, REC_MAGIC, sizeof(magic)) != 0) {
+            fprintf(stderr, "%s is not an mmrecord log\n", argv[i]);
+            exit(1);
+        }
+        do {
+            if (nrecs == maxrecs) {
+                maxrecs = maxrecs ? 2 * maxrecs : 65536;
+                if ((recs = realloc(recs, maxrecs * sizeof(rec_t))) == NULL) {
+                    fprintf(stderr, "rec2trace: out of memory\n");
+                    exit(1);
+                }
+            }
+            n = fread(recs + nrecs, sizeof(rec_t), maxrecs - nrecs, fp);
+            nrecs += n;
+        } while (n > 0);
+        fclose(fp);
+    }
+
+    /* Add the REC_PLACED records of the reallocs that moved their block */
+    nread = nrecs;
+    for (n = 0; n < nread; n++) {
+        if (recs[n].type != REC_REALLOC || recs[n].old == 0 || recs[n].ptr == 0 ||
+            recs[n].ptr == recs[n].old)
+            continue;
+        if (nrecs == maxrecs) {
+            maxrecs *= 2;
+            if ((recs = realloc(recs, maxrecs * sizeof(rec_t))) == NULL) {
+                fprintf(stderr, "rec2trace: out of memory\n");
+                exit(1);
+            }
+        }
+        memset(&recs[nrecs], 0, sizeof(rec_t));
+        recs[nrecs].seq = recs[n].done;
+        recs[nrecs].ptr = recs[n].ptr;
+        recs[nrecs].size = NO_ID;
+        recs[nrecs].type = REC_PLACED;
+        nrecs++;
+    }
+
+    /* Replay them in order */
+    table_size = 1024;
+    if ((table = calloc(table_size, sizeof(slot_t))) == NULL) {
+        fprintf(stderr, "rec2trace: out of memory\n");
+        exit(1);
+    }
+    qsort(recs, nrecs, sizeof(rec_t), compare_seq);
+    for (n = 0; n < nrecs; n++) {
+        if (num_ops == INT_MAX - 1) {
+            fprintf(stderr, "rec2trace: too many requests, trace cut short\n");
+            break;
+        }
+        convert(&recs[n]);
+    }
+    free(recs);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    hdr.sugg_heapsize = peak > INT_MAX ? INT_MAX : (int)peak;
+    hdr.num_ids = num_ids;
+    hdr.num_ops = num_ops;
+    hdr.weight = 1;
+
+    if ((fp = fopen(argv[optind], binary ? "wb" : "w")) == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if ((binary ? trace_write_bin(fp, &hdr, ops) : trace_write_rep(fp, &hdr, ops)) < 0 ||
+        fclose(fp) != 0) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    printf("%zu records, %d requests on %d ids (%ld records dropped), peak %zu bytes\n",
+           nread, num_ops, num_ids, dropped, peak);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * rep2bin.c - convert a text (.rep) trace into the binary trace format
+ *     of tracefmt.h, which mdriver maps and replays without parsing
+ *
+ * usage: rep2bin <in.rep> <out>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "tracefmt.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    trace_hdr_t hdr;
+    traceop_t *ops;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <in.rep> <out>\n", argv[0]);
+        exit(1);
+    }
+
+    if ((in = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if ((ops = trace_read_rep(in, argv[1], &hdr)) == NULL)
+        exit(1);
+    fclose(in);
+
+    if ((out = fopen(argv[2], "wb")) == NULL) {
+        perror(argv[2]);
+        exit(1);
+    }
+    if (trace_write_bin(out, &hdr, ops) < 0 || fclose(out) != 0) {
+        perror(argv[2]);
+        exit(1);
+    }
+    free(ops);
+    return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * tracefmt.c - read and write the text (.rep) and binary trace formats
+ *     described in tracefmt.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tracefmt.h"
+
+/* 
+ * trace_read_rep - Parse a text trace, one request at a time
+ */
+traceop_t *trace_read_rep(FILE *fp, const char *path, trace_hdr_t *hdr)
+{
+    traceop_t *ops;
+    char type[32];
+    int index, size, align;
+    int max_index = -1;
+    int op_index = 0;
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic));
+    hdr->version = TRACE_VERSION;
+    if (fscanf(fp, "%d %d %d %d", &hdr->sugg_heapsize, &hdr->num_ids, 
+               &hdr->num_ops, &hdr->weight) != 4 || 
+        hdr->num_ids < 0 || hdr->num_ops < 0) {
+        fprintf(stderr, "Bad header in tracefile %s\n", path);
+        return NULL;
+    }
+
+    /* We'll store each request line in the trace in this array */
+    if ((ops = (traceop_t *)malloc(hdr->num_ops * sizeof(traceop_t) + 1)) == NULL) {
+        fprintf(stderr, "malloc failed in trace_read_rep\n");
+        return NULL;
+    }
+
+    /* read every request line in the trace file */
+    while (fscanf(fp, "%31s", type) != EOF) {
+        if (op_index == hdr->num_ops) {
+            fprintf(stderr, "More than %d requests in tracefile %s\n", 
+                    hdr->num_ops, path);
+            free(ops);
+            return NULL;
+        }
+        size = align = 0;
+        switch (type[0]) {
+        case 'a':
+        case 'm':
+            ops[op_index].type = ALLOC;
+            break;
+        case 'r':
+            ops[op_index].type = REALLOC;
+            break;
+        case 'f':
+            ops[op_index].type = FREE;
+            break;
+        case 'c':
+            ops[op_index].type = CALLOC;
+            break;
+        default:
+            fprintf(stderr, "Bogus type character (%c) in tracefile %s\n", 
+                    type[0], path);
+            free(ops);
+            return NULL;
+        }
+        if (fscanf(fp, "%d", &index) != 1 || index < 0 ||
+            (ops[op_index].type != FREE && 
+             (fscanf(fp, "%d", &size) != 1 || size < 0)) ||
+            (type[0] == 'm' &&
+             (fscanf(fp, "%d", &align) != 1 || align <= 0 || (align & (align - 1))))) {
+            fprintf(stderr, "Bad request %d in tracefile %s\n", op_index, path);
+            free(ops);
+            return NULL;
+        }
+        ops[op_index].index = index;
+        ops[op_index].size = size;
+        ops[op_index].align = align;
+        max_index = (index > max_index) ? index : max_index;
+        op_index++;
+    }
+
+    if (op_index != hdr->num_ops || max_index != hdr->num_ids - 1) {
+        fprintf(stderr, "Header of tracefile %s does not match its requests\n", 
+                path);
+        free(ops);
+        return NULL;
+    }
+    return ops;
+}
+
+/* 
+ * trace_write_rep - Write the header fields one per line, then one
+ *     request per line
+ */
+int trace_write_rep(FILE *fp, const trace_hdr_t *hdr, const traceop_t *ops)
+{
+    if (trace_write_rep_hdr(fp, hdr) < 0)
+        return -1;
+    return trace_write_rep_ops(fp, ops, hdr->num_ops);
+}
+
+/* 
+ * trace_write_rep_hdr - Write the header fields one per line
+ */
+int trace_write_rep_hdr(FILE *fp, const trace_hdr_t *hdr)
+{
+    fprintf(fp, "%d\n%d\n%d\n%d\n", hdr->sugg_heapsize, hdr->num_ids, 
+            hdr->num_ops, hdr->weight);
+    return ferror(fp) ? -1 : 0;
+}
+
+/* 
+ * trace_write_rep_ops - Write n requests, one per line
+ */
+int trace_write_rep_ops(FILE *fp, const traceop_t *ops, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        switch (ops[i].type) {
+        case ALLOC:
+            if (ops[i].align > 0)
+                fprintf(fp, "m %d %d %d\n", ops[i].index, ops[i].size, ops[i].align);
+            else
+                fprintf(fp, "a %d %d\n", ops[i].index, ops[i].size);
+            break;
+        case REALLOC:
+            fprintf(fp, "r %d %d\n", ops[i].index, ops[i].size);
+            break;
+        case FREE:
+            fprintf(fp, "f %d\n", ops[i].index);
+            break;
+        case CALLOC:
+            fprintf(fp, "c %d %d\n", ops[i].index, ops[i].size);
+            break;
+        }
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+/* 
+ * trace_write_bin - Write the header and then the ops, as they are
+ */
+int trace_write_bin(FILE *fp, const trace_hdr_t *hdr, const traceop_t *ops)
+{
+    if (trace_write_bin_hdr(fp, hdr) < 0)
+        return -1;
+    return trace_write_bin_ops(fp, ops, hdr->num_ops);
+}
+
+/* 
+ * trace_write_bin_hdr, trace_write_bin_ops - Write the header, or n ops,
+ *     as they are
+ */
+int trace_write_bin_hdr(FILE *fp, const trace_hdr_t *hdr)
+{
+    return fwrite(hdr, sizeof(*hdr), 1, fp) == 1 ? 0 : -1;
+}
+
+int trace_write_bin_ops(FILE *fp, const traceop_t *ops, int n)
+{
+    return fwrite(ops, sizeof(traceop_t), n, fp) == (size_t)n ? 0 : -1;
+}
+
+/* 
+ * trace_is_bin - Check the magic number at the start of a file
+ */
+int trace_is_bin(const char *path)
+{
+    char magic[sizeof(TRACE_MAGIC)];
+    FILE *fp;
+    int is_bin;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+        return 0;
+    is_bin = fread(magic, sizeof(magic), 1, fp) == 1 && 
+        memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return is_bin;
+}
+
+/* 
+ * trace_map - Map a whole binary trace, and check that its header
+ *     matches this build and the length of the file, and that each op
+ *     is one the text format could express. The ops follow the header,
+ *     so they are used directly from the mapping.
+ */
+const traceop_t *trace_map(const char *path, trace_hdr_t *hdr, size_t *maplen)
+{
+    const traceop_t *ops, *op;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(trace_hdr_t)) {
+        fprintf(stderr, "Binary tracefile %s is truncated\n", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    memcpy(hdr, map, sizeof(*hdr));
+    if (hdr->version != TRACE_VERSION) {
+        fprintf(stderr, "Binary tracefile %s has version %u, expected %d\n", 
+                path, hdr->version, TRACE_VERSION);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    if (hdr->num_ids < 0 || hdr->num_ops < 0 ||
+        (size_t)st.st_size != sizeof(*hdr) + hdr->num_ops * sizeof(traceop_t)) {
+        fprintf(stderr, "Binary tracefile %s is corrupt\n", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    /* The replay, like the check below, reads the ops front to back */
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    ops = (const traceop_t *)((char *)map + sizeof(*hdr));
+
+    /* The replay trusts each op as it comes, as it does those of a
+     * parsed text trace, so reject here what trace_read_rep would */
+    for (op = ops; op < ops + hdr->num_ops; op++) {
+        if (op->type < ALLOC || op->type > CALLOC ||
+            op->index < 0 || op->index >= hdr->num_ids || op->size < 0 ||
+            op->align < 0 || (op->align & (op->align - 1))) {
+            fprintf(stderr, "Binary tracefile %s is corrupt (request %d)\n", 
+                    path, (int)(op - ops));
+            munmap(map, st.st_size);
+            return NULL;
+        }
+    }
+
+    *maplen = st.st_size;
+    return ops;
+}
+
+/* 
+ * trace_unmap - The mapping starts at the header, just before the ops
+ */
+void trace_unmap(const traceop_t *ops, size_t maplen)
+{
+    munmap((char *)ops - sizeof(trace_hdr_t), maplen);
+}
@@ -0,0 +1,98 @@
+/*
+ * tracefmt.h - the two formats of the trace files replayed by mdriver
+ *
+ * A trace is a sequence of allocator requests. The text (.rep) format,
+ * which remains the interchange format, is
+ *
+ *     <sugg_heapsize> <num_ids> <num_ops> <weight>
+ *
+ * followed by num_ops requests "a <id> <size>", "r <id> <size>" or
+ * "f <id>", "c <id> <size>" for a zeroed allocation (calloc), or
+ * "m <id> <size> <align>" for an allocation aligned to align bytes (a
+ * power of two). The binary format holds the same information as a trace_hdr_t
+ * followed by num_ops packed traceop_t records, in host byte order, so
+ * that a binary trace can be mapped into memory and replayed in place.
+ * rep2bin converts text traces to binary ones, and gentrace writes
+ * synthetic traces in either format.
+ */
+#ifndef __TRACEFMT_H_
+#define __TRACEFMT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* First bytes of a binary trace, and the version of its layout */
+#define TRACE_MAGIC    "MMTRACE"   /* 8 bytes with the terminating NUL */
+#define TRACE_VERSION  2
+
+/* Types of requests */
+enum {ALLOC, FREE, REALLOC, CALLOC};
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    int32_t type;     /* type of request */
+    int32_t index;    /* index for free() to use later */
+    int32_t size;     /* byte size of alloc/realloc request */
+    int32_t align;    /* alignment of an alloc request, or 0 for the default */
+} traceop_t;
+
+/* The header of a binary trace, which the ops directly follow */
+typedef struct {
+    char magic[8];          /* TRACE_MAGIC */
+    uint32_t version;       /* TRACE_VERSION */
+    int32_t sugg_heapsize;  /* suggested heap size (unused) */
+    int32_t num_ids;        /* number of alloc/realloc ids */
+    int32_t num_ops;        /* number of distinct requests */
+    int32_t weight;         /* weight for this trace (unused) */
+    int32_t reserved;       /* zero; pads the header to 32 bytes */
+} trace_hdr_t;
+
+/*
+ * trace_read_rep - Parse the text trace in fp (named path in messages)
+ *     into *hdr and a malloc'd array of ops.
+ *     Returns the array, or NULL after printing an error.
+ */
+traceop_t *trace_read_rep(FILE *fp, const char *path, trace_hdr_t *hdr);
+
+/*
+ * trace_write_rep - Write a text trace to fp.
+ *     Returns 0, or -1 if the write failed.
+ */
+int trace_write_rep(FILE *fp, const trace_hdr_t *hdr, const traceop_t *ops);
+
+/*
+ * trace_write_bin - Write a binary trace to fp.
+ *     Returns 0, or -1 if the write failed.
+ */
+int trace_write_bin(FILE *fp, const trace_hdr_t *hdr, const traceop_t *ops);
+
+/*
+ * trace_write_rep_hdr, trace_write_rep_ops, trace_write_bin_hdr,
+ * trace_write_bin_ops - Write a trace piecewise: the header, and then
+ *     the num_ops requests it announces, n at a time. Lets a trace be
+ *     written without holding all of it in memory.
+ *     Return 0, or -1 if the write failed.
+ */
+int trace_write_rep_hdr(FILE *fp, const trace_hdr_t *hdr);
+int trace_write_rep_ops(FILE *fp, const traceop_t *ops, int n);
+int trace_write_bin_hdr(FILE *fp, const trace_hdr_t *hdr);
+int trace_write_bin_ops(FILE *fp, const traceop_t *ops, int n);
+
+/*
+ * trace_is_bin - Returns 1 if the file at path starts with TRACE_MAGIC
+ */
+int trace_is_bin(const char *path);
+
+/*
+ * trace_map - Map the binary trace at path read-only into memory.
+ *     Fills in *hdr and the length of the mapping.
+ *     Returns the ops in place, or NULL after printing an error.
+ */
+const traceop_t *trace_map(const char *path, trace_hdr_t *hdr, size_t *maplen);
+
+/*
+ * trace_unmap - Unmap the ops returned by trace_map
+ */
+void trace_unmap(const traceop_t *ops, size_t maplen);
+
+#endif /* __TRACEFMT_H_ */